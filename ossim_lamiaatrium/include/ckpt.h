@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+
+#ifndef CKPT_H
+#define CKPT_H
+
+/*
+ * Simulation snapshot
+ *
+ * A snapshot holds the whole kernel instance between two time slots:
+ * timer, loader progress, scheduler queues, CPU states, every PCB with
+ * its code and memory map, and the RAM/swap images. Pointers are saved
+ * as PIDs or frame numbers and rebuilt on restore. The images start
+ * page aligned in the file and the restore maps them, a device backed
+ * by a host file gets its file back. With MM_PAGING, snapshots need
+ * the 64-bit paging (MM64).
+ */
+
+#include "common.h"
+
+#define CKPT_MAGIC "OSCKPT17"
+
+/* Write the state of [krnl] to [path], return 0 on success */
+int ckpt_save(struct krnl_t *krnl, const char *path);
+
+/* Rebuild [krnl] from the snapshot at [path]. The scheduler must be
+ * initialized and the memory devices allocated. A nonzero
+ * krnl->time_slot or krnl->num_cpus overrides the saved value.
+ * Return 0 on success, -1 on a missing or malformed snapshot */
+int ckpt_restore(struct krnl_t *krnl, const char *path);
+
+#endif
@@ -14,6 +14,9 @@
 #include "os-mm.h"
 #endif
 
+#include <pthread.h>
+#include "timer.h"
+
 #define ADDRESS_SIZE 20
 #define OFFSET_LEN 10
 #define FIRST_LV_LEN 5
@@ -97,6 +100,7 @@ struct pcb_t
 {
 #ifdef MM_PAGING
     struct mm_struct *mm;
+    struct tlb_t *tlb;	/* TLB of the CPU running the process */
 #endif
 	uint32_t pid;
 	uint32_t priority;
@@ -114,20 +118,79 @@ struct pcb_t
 	uint32_t bp;
 };
 
+/* What a CPU is running, kept in the kernel so a snapshot can see it */
+struct cpu_state_t
+{
+	struct pcb_t *proc;
+	int time_left;
+	int stopped;
+#ifdef MM_PAGING
+	struct tlb_t tlb;
+#endif
+};
+
+/* Kernel instance, every state of one simulation lives here so that
+ * many simulations can run side by side in the same host process
+ */
 struct krnl_t
 {
+	/* OS configuration */
+	int time_slot;
+	int num_cpus;
+	int done;
+	struct ld_args *ld_processes;
+	struct evlog_t *log;
+	struct cpu_state_t *cpus;	/* array of num_cpus entries */
+
+	/* Snapshot, taken when the timer reaches ckpt_time */
+	const char *ckpt_path;
+	uint64_t ckpt_time;
+
+	/* Timer */
+	struct sys_timer_t timer;
+
+	/* Scheduler */
 	struct queue_t *ready_queue;
+	struct queue_t *run_queue;
 	struct queue_t *running_list;
+	pthread_mutex_t queue_lock;
 #ifdef MLQ_SCHED
 	struct queue_t *mlq_ready_queue;
+	int slot[MAX_PRIO];
+	int current_slot[MAX_PRIO];
+	int current_prio;
+	pthread_mutex_t dispatch_lock;
 #endif
+
+	/* Loader */
+	uint32_t avail_pid;
+
 #ifdef MM_PAGING
 	struct mm_struct *mm;
 	struct memphy_struct *mram;
-	struct memphy_struct **mswp;
+	struct memphy_struct *mswp;	/* array of PAGING_MAX_MMSWP devices */
 	struct memphy_struct *active_mswp;
-	uint32_t active_mswp_id;
+	uint32_t active_mswp_id;	/* device of the last new swap run */
+	int mswp_prio[PAGING_MAX_MMSWP];	/* higher is used first */
+	uint64_t nr_swpout_dev[PAGING_MAX_MMSWP];
+	struct zswap_t *zswap;		/* compressed swap cache, NULL if off */
+	struct ksm_t *ksm;		/* same page merging, NULL if off */
+	struct shm_seg_t *shm;		/* MM_SHM_MAX shared memory segments */
+	const struct mm_policy_t *mm_policy;	/* page replacement */
+	uint64_t nr_pgfault;		/* page faults, all kinds */
+	uint64_t nr_pgfault_swp;	/* page faults served from swap */
+	uint64_t nr_readahead;		/* pages swapped in ahead of a fault */
+	uint64_t nr_swpout;		/* pages written to swap */
+	uint64_t nr_swpout_clean;	/* clean pages dropped, swap copy kept */
+	uint64_t nr_steal;		/* frames reclaimed from another process */
+	uint64_t nr_reclaim;		/* frames reclaimed, for the decay */
+	uint64_t nr_kswapd;		/* frames reclaimed by kswapd */
+	uint64_t nr_cow;		/* shared frames copied on a write */
+#ifdef MM64
+	struct mm_struct *mm_list;	/* every mm, for the global reclaim */
+#endif
+	pthread_mutex_t mmvm_lock;
 #endif
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+#ifndef EVLOG_H
+#define EVLOG_H
+
+/*
+ * Asynchronous event log
+ *
+ * Every producer thread (timer, loader, CPUs) owns a lock-free single
+ * producer ring of fixed size binary records. A logger thread merges
+ * the rings by global sequence number and either decodes them to the
+ * usual text output or dumps them raw into a binary log file which
+ * can be decoded later with evlog_decode().
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define EVLOG_RING_SZ 4096 /* records per producer ring, power of two */
+#define EVLOG_STR_SZ 40
+#define EVLOG_MAGIC "OSEVLOG1"
+
+enum evlog_mode_t {
+	EVLOG_TEXT,   /* decode to stdout while running (default) */
+	EVLOG_BINARY, /* dump raw records into a file */
+	EVLOG_QUIET,  /* keep only summary statistics */
+};
+
+enum evlog_type_t {
+	EV_TEXT,         /* free formatted message */
+	EV_CONT,         /* continuation of a string payload */
+	EV_TIME_SLOT,
+	EV_LD_ROUTINE,
+	EV_LD_LOADED,
+	EV_CPU_DISPATCH,
+	EV_CPU_PUT,
+	EV_CPU_FINISH,
+	EV_CPU_STOP,
+	EV_ALLOC,
+	EV_FREE,
+	EV_READ,
+	EV_WRITE,
+	EV_PGTBL,
+	EV_FORK,
+	EV_CLONE,
+	EV_READ_VAL,
+	EV_MAX
+};
+
+/* Record flag: string payload continues in the next EV_CONT records */
+#define EVLOG_F_MORE 0x1
+
+struct evlog_rec_t {
+	uint64_t seq;
+	uint16_t type;
+	uint16_t flags;
+	uint32_t id;
+	union {
+		uint64_t arg[6];
+		struct {
+			uint64_t val;
+			char str[EVLOG_STR_SZ];
+		} s;
+	} u;
+};
+
+struct evlog_ring_t {
+	struct evlog_rec_t rec[EVLOG_RING_SZ];
+	_Atomic uint64_t head; /* written by the owner thread only */
+	_Atomic uint64_t tail; /* written by the logger thread only */
+	unsigned long count[EV_MAX];
+	struct evlog_ring_t *next;
+};
+
+struct evlog_t {
+	uint64_t id;
+	int mode;
+	FILE *out;
+	_Atomic uint64_t seq;
+	struct evlog_ring_t *_Atomic rings;
+	pthread_mutex_t rings_lock;
+	pthread_t thread;
+	atomic_int stop;
+	char *text;    /* quiet mode: text messages, printed by evlog_stop */
+	size_t textlen;
+};
+
+int evlog_init(struct evlog_t *log, int mode, const char *path);
+void evlog_stop(struct evlog_t *log);
+
+/* Producer side, [log] may be NULL to print synchronously */
+void evlog_event(struct evlog_t *log, int type, uint32_t id,
+                 uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3);
+void evlog_str(struct evlog_t *log, int type, uint32_t id,
+               uint64_t val, const char *str);
+void evlog_printf(struct evlog_t *log, const char *fmt, ...);
+
+/* Convert a binary log back to the text output */
+int evlog_decode(FILE *in, FILE *out);
+
+#endif
@@ -12,9 +12,10 @@
 
 #define SYSMEM_MAP_OP 1
 #define SYSMEM_INC_OP 2
-#define SYSMEM_SWP_OP 3
+#define SYSMEM_SWP_OP 3      /* a4 holds the swap device */
 #define SYSMEM_IO_READ 4
 #define SYSMEM_IO_WRITE 5
+#define SYSMEM_SWPIN_OP 6    /* a4 holds the swap device */
 
 extern struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid);
 int liballoc(struct pcb_t *, addr_t, uint32_t);
@@ -3,7 +3,7 @@
 
 #include "common.h"
 
-struct pcb_t * load(const char * path);
+struct pcb_t * load(struct krnl_t * krnl, const char * path);
 
 #endif
 
@@ -1,4 +1,5 @@
 #ifndef MM_H
+#define MM_H
 
 #include "common.h"
 #include "bitops.h"
@@ -15,17 +16,62 @@
 
 #define PAGING_SBRK_INIT_SZ PAGING_PAGESZ
 /* PTE BIT */
+#ifdef MM64
+/* 64-bit PTE, flags sit in the upper half. Bit 63 is left to the
+ * HUGE mark of PMD entries, see mm64.h */
+#define PAGING_PTE_PRESENT_MASK  BIT_ULL(62)
+#define PAGING_PTE_SWAPPED_MASK  BIT_ULL(61)
+#define PAGING_PTE_ZERO_MASK     BIT_ULL(60) /* read only zero frame */
+#define PAGING_PTE_DIRTY_MASK    BIT_ULL(59) /* written since mapped */
+#define PAGING_PTE_ACCESSED_MASK BIT_ULL(58) /* used since last cleared */
+#define PAGING_PTE_SWPCOPY_MASK  BIT_ULL(57) /* SWPCOPY slot holds the page */
+#define PAGING_PTE_COW_MASK      BIT_ULL(56) /* shared frame, copied on write */
+#else
 #define PAGING_PTE_PRESENT_MASK BIT(31) 
 #define PAGING_PTE_SWAPPED_MASK BIT(30)
 #define PAGING_PTE_RESERVE_MASK BIT(29)
+#define PAGING_PTE_ZERO_MASK PAGING_PTE_RESERVE_MASK /* read only zero frame */
 #define PAGING_PTE_DIRTY_MASK BIT(28)
 #define PAGING_PTE_EMPTY01_MASK BIT(14)
 #define PAGING_PTE_EMPTY02_MASK BIT(13)
+#endif
+
+/* Frame 0 of RAM is reserved as the zero frame, every page read
+ * before it is ever written maps it. A RAM of a single frame keeps
+ * it for data instead */
+#define PAGING_ZERO_FPN 0
+#define PAGING_HAS_ZERO_FRAME(mp) ((mp)->numfp > 1)
 
 /* PTE BIT PRESENT */
 #define PAGING_PTE_SET_PRESENT(pte) (pte=pte|PAGING_PTE_PRESENT_MASK)
 #define PAGING_PAGE_PRESENT(pte) (pte&PAGING_PTE_PRESENT_MASK)
 
+#ifdef MM64
+/* FPN */
+#define PAGING_PTE_FPN_LOBIT 0
+#define PAGING_PTE_FPN_HIBIT 31
+/* SWPTYP */
+#define PAGING_PTE_SWPTYP_LOBIT 0
+#define PAGING_PTE_SWPTYP_HIBIT 4
+/* SWPOFF */
+#define PAGING_PTE_SWPOFF_LOBIT 5
+#define PAGING_PTE_SWPOFF_HIBIT 25
+/* SWPCOPY, swap slot kept by a page brought back in and not written,
+ * and the device it is on */
+#define PAGING_PTE_SWPCOPY_LOBIT 32
+#define PAGING_PTE_SWPCOPY_HIBIT 52
+#define PAGING_PTE_SWPCOPY_TYP_LOBIT 53
+#define PAGING_PTE_SWPCOPY_TYP_HIBIT 55
+
+/* PTE */
+#define PAGING_PTE_FPN_MASK    GENMASK_ULL(PAGING_PTE_FPN_HIBIT,PAGING_PTE_FPN_LOBIT)
+#define PAGING_PTE_SWPTYP_MASK GENMASK_ULL(PAGING_PTE_SWPTYP_HIBIT,PAGING_PTE_SWPTYP_LOBIT)
+#define PAGING_PTE_SWPOFF_MASK GENMASK_ULL(PAGING_PTE_SWPOFF_HIBIT,PAGING_PTE_SWPOFF_LOBIT)
+#define PAGING_PTE_SWPCOPY_OFF_MASK GENMASK_ULL(PAGING_PTE_SWPCOPY_HIBIT,PAGING_PTE_SWPCOPY_LOBIT)
+#define PAGING_PTE_SWPCOPY_TYP_MASK GENMASK_ULL(PAGING_PTE_SWPCOPY_TYP_HIBIT,PAGING_PTE_SWPCOPY_TYP_LOBIT)
+#define PAGING_SWPCOPY(pte) GETVAL(pte,PAGING_PTE_SWPCOPY_OFF_MASK,PAGING_PTE_SWPCOPY_LOBIT)
+#define PAGING_SWPCOPY_TYP(pte) GETVAL(pte,PAGING_PTE_SWPCOPY_TYP_MASK,PAGING_PTE_SWPCOPY_TYP_LOBIT)
+#else
 /* USRNUM */
 #define PAGING_PTE_USRNUM_LOBIT 15
 #define PAGING_PTE_USRNUM_HIBIT 27
@@ -44,6 +90,8 @@
 #define PAGING_PTE_FPN_MASK    GENMASK(PAGING_PTE_FPN_HIBIT,PAGING_PTE_FPN_LOBIT)
 #define PAGING_PTE_SWPTYP_MASK GENMASK(PAGING_PTE_SWPTYP_HIBIT,PAGING_PTE_SWPTYP_LOBIT)
 #define PAGING_PTE_SWPOFF_MASK GENMASK(PAGING_PTE_SWPOFF_HIBIT,PAGING_PTE_SWPOFF_LOBIT)
+#endif
+#define PAGING_SWPTYP(pte) GETVAL(pte,PAGING_PTE_SWPTYP_MASK,PAGING_PTE_SWPTYP_LOBIT)
 
 /* Extract PTE */
 #define PAGING_PTE_OFFST(pte) GETVAL(pte,PAGING_OFFST_MASK,PAGING_ADDR_OFFST_LOBIT)
@@ -101,20 +149,46 @@
 /* VM region prototypes */
 struct vm_rg_struct * init_vm_rg(addr_t rg_start, addr_t rg_end);
 int enlist_vm_rg_node(struct vm_rg_struct **rglist, struct vm_rg_struct* rgnode);
+#ifdef MM64
+int enlist_pgn_node(struct mm_struct *mm, addr_t pgn, addr_t fpn);
+int delist_pgn_node(struct mm_struct *mm, addr_t fpn);
+#else
 int enlist_pgn_node(struct pgn_t **pgnlist, addr_t pgn);
+#endif
 int vmap_pgd_memset(struct pcb_t *caller, addr_t addr, int pgnum);
+#ifndef MM64
 addr_t vmap_page_range(struct pcb_t *caller, addr_t addr, int pgnum, 
                     struct framephy_struct *frames, struct vm_rg_struct *ret_rg);
 addr_t vm_map_ram(struct pcb_t *caller, addr_t astart, addr_t aend, addr_t mapstart, int incpgnum, struct vm_rg_struct *ret_rg);
 addr_t alloc_pages_range(struct pcb_t *caller, int incpgnum, struct framephy_struct **frm_lst);
+#endif
 int __swap_cp_page(struct memphy_struct *mpsrc, addr_t srcfpn,
                 struct memphy_struct *mpdst, addr_t dstfpn) ;
 int get_pd_from_address(addr_t addr, addr_t* pgd, addr_t* p4d, addr_t* pud, addr_t* pmd, addr_t* pt);
 int get_pd_from_pagenum(addr_t pgn, addr_t* pgd, addr_t* p4d, addr_t* pud, addr_t* pmd, addr_t* pt);
 int pte_set_fpn(struct pcb_t *caller, addr_t pgn, addr_t fpn);
 int pte_set_swap(struct pcb_t *caller, addr_t pgn, int swptyp, addr_t swpoff);
-uint32_t pte_get_entry(struct pcb_t *caller, addr_t pgn);
-int pte_set_entry(struct pcb_t *caller, addr_t pgn, uint32_t pte_val);
+#ifdef MM64
+int pgtbl_set_swap(struct krnl_t *krnl, struct mm_struct *mm, addr_t pgn,
+                   int swptyp, addr_t swpoff);
+void mm_link(struct krnl_t *krnl, struct mm_struct *mm);
+void mm_unlink(struct krnl_t *krnl, struct mm_struct *mm);
+void mm_lock_init(struct mm_struct *mm);
+#endif
+uint64_t pte_get_entry(struct pcb_t *caller, addr_t pgn);
+#ifdef MM64
+int pgtbl_store(struct mm_struct *mm, addr_t pgn, uint64_t pte);
+uint64_t pgtbl_load(struct mm_struct *mm, addr_t pgn);
+int pgtbl_update(struct mm_struct *mm, addr_t pgn, uint64_t setmask, uint64_t clrmask);
+int pgtbl_store_huge(struct mm_struct *mm, addr_t pgn, uint64_t pte);
+int vmap_huge_page(struct pcb_t *caller, addr_t pgn);
+int map_range(struct pcb_t *caller, addr_t pgn, int pgnum, const addr_t *fpn);
+int unmap_range(struct pcb_t *caller, addr_t pgn, int pgnum);
+int pgtbl_for_each(struct mm_struct *mm,
+                   int (*fn)(addr_t pgn, uint64_t pte, void *arg), void *arg);
+void pgtbl_free(struct mm_struct *mm);
+#endif
+int pte_set_entry(struct pcb_t *caller, addr_t pgn, uint64_t pte_val);
 int init_pte(addr_t *pte,
              int pre,    // present
              addr_t fpn,    // FPN
@@ -127,6 +201,10 @@ int __free(struct pcb_t *caller, int vmaid, int rgid);
 int __read(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE *data);
 int __write(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE value);
 int init_mm(struct mm_struct *mm, struct pcb_t *caller);
+#ifdef MM64
+int dup_mm(struct mm_struct *mm, struct pcb_t *caller, struct mm_struct *src);
+#endif
+int free_pcb_memph(struct pcb_t *caller);
 
 /* VM prototypes */
 int pgalloc(struct pcb_t *proc, uint32_t size, uint32_t reg_index);
@@ -143,19 +221,116 @@ int pgwrite(
 		addr_t offset);
 /* Local VM prototypes */
 struct vm_rg_struct * get_symrg_byid(struct mm_struct* mm, int rgid);
+int enlist_vm_freerg_list(struct mm_struct *mm, struct vm_rg_struct *rg_elmt);
 int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, addr_t vmastart, addr_t vmaend);
 int get_free_vmrg_area(struct pcb_t *caller, int vmaid, int size, struct vm_rg_struct *newrg);
 int inc_vma_limit(struct pcb_t *caller, int vmaid, addr_t inc_sz);
-int find_victim_page(struct mm_struct* mm, addr_t *pgn);
+int find_victim_page(struct krnl_t *krnl, struct mm_struct* mm, addr_t *pgn);
+#ifdef MM64
+int kswapd_balance(struct krnl_t *krnl);
+int pg_getframe(struct pcb_t *caller, addr_t *fpn);
+#endif
 struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid);
+struct vm_area_struct *get_vma_by_addr(struct mm_struct *mm, addr_t addr);
+
+/*
+ * Page replacement policy. The resident pages of an mm enter with
+ * insert, leave with remove, and victim picks and takes one off
+ */
+struct mm_policy_t {
+   const char *name;
+   void (*insert)(struct mm_struct *mm, addr_t pgn, addr_t fpn);
+   void (*remove)(struct mm_struct *mm, addr_t fpn);
+   int (*victim)(struct krnl_t *krnl, struct mm_struct *mm, addr_t *pgn);
+   void (*release)(struct mm_struct *mm);
+};
+
+/* Replacement policy prototypes */
+const struct mm_policy_t *mm_policy_get(const char *name);
+#ifdef MM64
+void pglist_push(struct mm_struct *mm, int list, addr_t pgn, addr_t fpn);
+void pglist_unlink(struct mm_struct *mm, addr_t fpn);
+struct arc_t *arc_get(struct mm_struct *mm);
+int arc_ghost_push(struct arc_t *arc, int list, addr_t pgn);
+#endif
+
+/* Compressed swap cache prototypes */
+#ifdef MM64
+int zswap_init(struct zswap_t *zs, addr_t numfp);
+void zswap_destroy(struct zswap_t *zs);
+void zswap_relink(struct zswap_t *zs);
+void zswap_lru_push(struct zswap_t *zs, addr_t idx);
+int zswap_store(struct krnl_t *krnl, struct mm_struct *mm, addr_t pgn,
+                addr_t fpn, int take, addr_t *off);
+int zswap_load(struct krnl_t *krnl, addr_t off, addr_t tgtfpn);
+void zswap_invalidate(struct krnl_t *krnl, addr_t off);
+int zswap_dup(struct krnl_t *krnl, addr_t off, struct mm_struct *mm, addr_t pgn);
+int swap_get_slot(struct krnl_t *krnl, struct mm_struct *mm, addr_t pgn,
+                  int *swptyp, addr_t *swpfpn);
+#endif
+
+#ifdef MM64
+/* Shared frame prototypes */
+int frame_share(struct krnl_t *krnl, addr_t fpn, struct mm_struct *mm, addr_t pgn);
+void frame_unmap(struct krnl_t *krnl, addr_t fpn, struct mm_struct *mm, addr_t pgn);
+void frame_unmap_mm(struct krnl_t *krnl, struct mm_struct *mm);
+void frame_settle(struct krnl_t *krnl, addr_t fpn);
+void rmap_del(struct memphy_struct *mp, addr_t fpn, struct mm_struct *mm, addr_t pgn);
+int rmap_rebuild(struct krnl_t *krnl);
+
+/* Same page merging prototypes */
+int ksm_init(struct ksm_t *ks, addr_t numfp);
+void ksm_destroy(struct ksm_t *ks);
+void ksm_forget(struct krnl_t *krnl, addr_t fpn);
+void ksm_rehash(struct krnl_t *krnl);
+int ksm_scan(struct krnl_t *krnl, int nr);
+#endif
+
+/* Shared memory prototypes */
+#ifdef MM64
+int shm_get(struct krnl_t *krnl, struct pcb_t *caller, uint32_t key,
+            addr_t size, int *id);
+int shm_attach(struct krnl_t *krnl, struct pcb_t *caller, int id, int rgid);
+int shm_detach(struct krnl_t *krnl, struct pcb_t *caller, int rgid);
+void shm_detach_mm(struct krnl_t *krnl, struct mm_struct *mm);
+int shm_dup(struct krnl_t *krnl, struct mm_struct *mm, struct mm_struct *src);
+void shm_destroy(struct shm_seg_t *shm);
+#endif
+
+/* TLB prototypes */
+void tlb_init(struct tlb_t *tlb);
+void tlb_destroy(struct tlb_t *tlb);
+int tlb_lookup(struct tlb_t *tlb, uint32_t asid, addr_t pgn, int write, addr_t *fpn);
+void tlb_fill(struct tlb_t *tlb, uint32_t asid, addr_t pgn, addr_t fpn,
+              int huge, int dirty);
+void tlb_shootdown(struct krnl_t *krnl, uint32_t asid, addr_t pgn);
+void tlb_flush_asid(struct krnl_t *krnl, uint32_t asid);
 
 /* MEM/PHY protypes */
 int MEMPHY_get_freefp(struct memphy_struct *mp, addr_t *fpn);
+int MEMPHY_is_freefp(struct memphy_struct *mp, addr_t fpn);
+int MEMPHY_get_freefp_near(struct memphy_struct *mp, addr_t hint,
+                           addr_t nclust, addr_t *fpn);
 int MEMPHY_put_freefp(struct memphy_struct *mp, addr_t fpn);
+void MEMPHY_clear_freefp(struct memphy_struct *mp);
+int MEMPHY_get_freefp_range(struct memphy_struct *mp, addr_t nfp, addr_t *fpn);
+int MEMPHY_clear_frames(struct memphy_struct *mp, addr_t fpn, addr_t nfp,
+                        addr_t pagesz);
 int MEMPHY_read(struct memphy_struct * mp, addr_t addr, BYTE *value);
 int MEMPHY_write(struct memphy_struct * mp, addr_t addr, BYTE data);
 int MEMPHY_dump(struct memphy_struct * mp);
+int MEMPHY_mv_csr(struct memphy_struct *mp, addr_t offset);
+int MEMPHY_seq_xfer(struct memphy_struct *mp, addr_t addr, addr_t len);
+int MEMPHY_xfer_page(struct memphy_struct *src, addr_t srcfpn,
+                     struct memphy_struct *dst, addr_t dstfpn, addr_t pagesz);
+int MEMPHY_set_seqcost(struct memphy_struct *mp, uint64_t seek_ns,
+                       uint64_t seek_ns_per_mb, uint64_t xfer_ns_per_kb);
 int init_memphy(struct memphy_struct *mp, addr_t max_size, int randomflg);
+int init_memphy_file(struct memphy_struct *mp, addr_t max_size, int randomflg,
+                     const char *path);
+int init_memphy_image(struct memphy_struct *mp, addr_t max_size, int randomflg,
+                      int fd, addr_t off);
+int free_memphy(struct memphy_struct *mp);
 
 /* print list */
 int print_list_fp(struct framephy_struct *fp);
@@ -163,6 +338,10 @@ int print_list_rg(struct vm_rg_struct *rg);
 int print_list_vma(struct vm_area_struct *rg);
 
 
+#ifdef MM64
+int print_list_pgn(struct mm_struct *mm);
+#else
 int print_list_pgn(struct pgn_t *ip);
+#endif
 int print_pgtbl(struct pcb_t *ip, addr_t start, addr_t end);
 #endif
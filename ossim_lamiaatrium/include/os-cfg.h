@@ -18,6 +18,28 @@
 // #define MM_FIXED_MEMSZ
 //#define VMDBG 1
 //#define MMDBG 1
+// #define MM_SEQ_SWAP    /* swap devices are sequential (disk like) */
+#define MEMPHY_SEEK_NS 4000000
+#define MEMPHY_SEEK_NS_PER_MB 1000
+#define MEMPHY_XFER_NS_PER_KB 10000
+// #define MEMPHY_NT_STORE  /* bypass the host cache when moving frames */
+#define MM_TLB_SETS 16     /* per CPU TLB geometry, sets is a power of two */
+#define MM_TLB_WAYS 4
+#define MM_AGE_BITS 8      /* aging counter width of the LRU policy */
+#define MM_ARC_HASH_SZ 256 /* buckets of the ARC ghost lists */
+#define MM_ACTIVITY_DECAY 16 /* global reclaims between halvings of mm activity */
+#define MM_KSWAPD          /* background reclaim between the watermarks */
+#define MM_WMARK_LOW 5     /* percent of RAM frames, kswapd wakes below */
+#define MM_WMARK_HIGH 10   /* percent of RAM frames, kswapd sleeps above */
+#define MM_SWAP_CLUSTER 16  /* swap slots set aside for a run of evictions */
+#define MM_SWAP_READAHEAD 8 /* swapped neighbours read in by a swap fault */
+#define MM_SWAP_READAHEAD_RECLAIM 4 /* frames they may evict once RAM is full */
+#define MM_ZSWAP            /* compressed swap cache in RAM */
+#define MM_ZSWAP_POOL_PCT 20 /* percent of RAM frames the cache may hold */
+#define MM_KSM              /* merge identical frames in the background */
+#define MM_KSM_SCAN 64      /* frames ksmd checksums per time slot */
+#define MM_SHM_MAX 16       /* shared memory segments of the kernel */
+#define MM_SHM_PCT 50       /* percent of RAM frames the segments may hold */
 #define IODUMP 1
 #define PAGETBL_DUMP 1
 
@@ -30,4 +52,12 @@
 #define MM64 1
 // #undef MM64
 
+/* Background reclaim, the compressed swap cache and same page merging
+ * work on the page lists and PTEs of the 64-bit paging */
+#ifndef MM64
+#undef MM_KSWAPD
+#undef MM_ZSWAP
+#undef MM_KSM
+#endif
+
 #endif
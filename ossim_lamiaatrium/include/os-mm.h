@@ -12,6 +12,7 @@
 #define OSMM_H
 
 #include <stdint.h>
+#include <pthread.h>
 
 #define MM_PAGING
 #define PAGING_MAX_MMSWP 4 /* max number of supported swapped space */
@@ -50,6 +51,62 @@ struct pgn_t{
    struct pgn_t *pg_next; 
 };
 
+/*
+ * Frame descriptor, one per frame of a device. The frame of a
+ * resident page links it into a page list of its mm, so the lists
+ * of the replacement policy need no node of their own. A frame
+ * shared read only by several pages keeps them on its reverse map,
+ * one of them lists it. A frame of a shared memory segment is on no
+ * list at all
+ */
+#define FRAME_NIL ((addr_t)-1)
+
+struct rmap_t {
+   struct mm_struct *mm;
+   addr_t pgn;
+   struct rmap_t *next;
+};
+
+struct framedesc_t {
+   struct mm_struct *owner;   /* mm whose list holds the frame, NULL if none */
+   addr_t pgn;
+   addr_t prev;               /* newer page, FRAME_NIL at the head */
+   addr_t next;               /* older page, FRAME_NIL at the tail */
+   uint32_t list;             /* which list of the owner */
+   uint32_t age;              /* aging counter of the LRU policy */
+   uint32_t nref;             /* pages sharing the frame, 0 if private */
+   struct rmap_t *rmap;       /* those pages */
+   uint32_t shm;              /* 1 + id of its shared memory segment, 0 if none */
+};
+
+struct pglist_t {
+   addr_t head;               /* newest page */
+   addr_t tail;               /* oldest page */
+   addr_t nr;
+};
+
+/*
+ * ARC state of one mm. T1 and T2 are the page lists 0 and 1 of the
+ * mm, B1 and B2 remember the pages evicted from them
+ */
+struct arc_ghost_t {
+   addr_t pgn;
+   int list;
+   struct arc_ghost_t *prev;  /* newer ghost */
+   struct arc_ghost_t *next;  /* older ghost */
+   struct arc_ghost_t *hnext; /* hash chain */
+};
+
+struct arc_t {
+   addr_t p;                  /* target size of T1 */
+   struct arc_ghost_t *head[2];
+   struct arc_ghost_t *tail[2];
+   addr_t nr[2];
+   struct arc_ghost_t *hash[MM_ARC_HASH_SZ];
+};
+
+#define MM_NR_PGLIST 2
+
 /*
  *  Memory region struct
  */
@@ -78,16 +135,134 @@ struct vm_area_struct {
    struct vm_area_struct *vm_next;
 };
 
+#ifdef MM64
+/*
+ * One table of the 5-level page table. An upper level entry holds the
+ * address of its child table, a PT entry holds the PTE; 0 is empty
+ */
+#define PAGING64_TBL_ENTRIES 512
+struct pgtbl64_t {
+   uint64_t ent[PAGING64_TBL_ENTRIES];
+   uint32_t nr_used;    /* nonzero entries, the table goes at 0 */
+};
+#endif
+
+/*
+ * Software TLB of one CPU, set associative, entries are tagged
+ * with the ASID of their mm so a switch needs no flush. A huge
+ * entry covers a whole huge page from its first pgn and fpn.
+ * A write through an entry not yet dirty goes to the page table
+ */
+struct tlb_entry_t {
+   uint32_t asid;
+   uint8_t valid;
+   uint8_t huge;
+   uint8_t dirty;
+   addr_t pgn;
+   addr_t fpn;
+};
+
+struct tlb_t {
+   struct tlb_entry_t ent[MM_TLB_SETS][MM_TLB_WAYS];
+   uint32_t next[MM_TLB_SETS];   /* round robin victim of each set */
+   uint64_t hits;
+   uint64_t misses;
+   uint64_t shootdowns;
+   pthread_mutex_t lock;         /* shootdowns come from other CPUs */
+};
+
+/*
+ * Compressed swap cache. Evicted pages are packed into chunks of pool
+ * frames taken from RAM, a PTE swapped there has ZSWAP_SWPTYP for its
+ * swap type and the entry index for its offset. Entries are kept on
+ * an LRU list, the coldest are written back to a swap device when the
+ * pool is full
+ */
+#define ZSWAP_SWPTYP PAGING_MAX_MMSWP
+#define ZSWAP_NCHUNK 32             /* chunks of a pool frame, bits of map */
+
+struct zswap_entry_t {
+   struct mm_struct *owner;   /* NULL when unused */
+   addr_t pgn;
+   addr_t fpn;                /* pool frame */
+   uint32_t chunk;            /* first chunk in the frame */
+   uint32_t len;              /* compressed bytes */
+   addr_t prev;               /* newer entry, FRAME_NIL at the head */
+   addr_t next;               /* older entry, or next unused one */
+};
+
+struct zswap_t {
+   struct zswap_entry_t *ent;
+   addr_t nent;
+   addr_t free_ent;           /* unused entries, linked by next */
+   addr_t lru_head, lru_tail;
+   addr_t *pool;              /* pool frames in RAM */
+   uint32_t *map;             /* used chunks of each pool frame */
+   addr_t npool, maxpool;
+
+   uint64_t nr_store;         /* pages taken in */
+   uint64_t nr_reject;        /* pages that did not compress enough */
+   uint64_t nr_nomem;         /* pages turned away for lack of pool room */
+   uint64_t nr_load;          /* swap faults served from the pool */
+   uint64_t nr_writeback;     /* cold pages moved on to a swap device */
+   uint64_t bytes_stored;     /* compressed size of the pages taken in */
+};
+
+/*
+ * Same page merging. Resident frames are checksummed in turn, one
+ * whose checksum held over a whole pass is looked up among the
+ * others by it. The shared frames stay in the table, the private
+ * ones seen in this pass are only candidates and are dropped when
+ * the pass wraps
+ */
+#define KSM_NONE 0
+#define KSM_UNSTABLE 1
+#define KSM_STABLE 2
+
+struct ksm_t {
+   uint32_t *csum;            /* checksum of each frame at its last scan */
+   uint8_t *state;
+   addr_t *bucket;            /* frames by checksum, linked by hnext */
+   addr_t *hnext;
+   addr_t nbucket;
+   addr_t cursor;             /* next frame to scan */
+
+   uint64_t nr_merge;         /* pages mapped onto an identical frame */
+   uint64_t nr_zero;          /* pages mapped onto the zero frame */
+   uint64_t nr_pass;          /* full passes over RAM */
+   uint64_t max_saved;        /* most frames saved by sharing at a pass end */
+};
+
+/*
+ * Shared memory segment. Its frames are taken when it is created and
+ * stay until its last attachment goes, every attached address space
+ * maps them writable at a page aligned region. They are counted by
+ * attachment and kept off the page lists, so no replacement policy
+ * picks them
+ */
+struct shm_attach_t {
+   struct mm_struct *mm;
+   addr_t pgn;                /* first page of the mapping */
+   struct shm_attach_t *next;
+};
+
+struct shm_seg_t {
+   uint32_t key;              /* 0 for a private segment */
+   addr_t npages;
+   addr_t *fpn;               /* its frames, NULL if the slot is free */
+   uint32_t nattch;           /* mappings of the frames */
+   struct shm_attach_t *attach;
+};
+
 /* 
  * Memory management struct
  */
 struct mm_struct {
+   uint32_t asid;           /* address space tag of the TLB entries */
 #ifdef MM64
-   uint64_t *pgd;
-   uint64_t *p4d;
-   uint64_t *pud;
-   uint64_t *pmd;
-   uint64_t *pt;
+   struct pgtbl64_t *pgd;   /* root, lower tables are allocated on demand */
+   uint64_t nr_pgtbl;       /* tables currently allocated, root included */
+   uint64_t nr_huge;        /* PMD entries mapping a whole huge page */
 #else
    uint32_t *pgd;
 #endif
@@ -97,8 +272,31 @@ struct mm_struct {
    /* Currently we support a fixed number of symbol */
    struct vm_rg_struct symrgtbl[PAGING_MAX_SYMTBL_SZ];
 
+#ifdef MM64
+   /* Resident pages, linked through the frame descriptors of
+    * frm_mp. How the lists are used is up to the policy */
+   struct memphy_struct *frm_mp;
+   const struct mm_policy_t *policy;
+   struct pglist_t pglist[MM_NR_PGLIST];
+   struct arc_t *arc;         /* ARC only, made on first use */
+
+   /* Global reclaim, every mm of the kernel is on one list */
+   struct mm_struct *mm_next;
+   _Atomic uint64_t activity; /* accesses, decays as reclaim goes on */
+
+   /* Threads of a process share the mm. Its lock guards the areas,
+    * regions, symbols and the page table, so a TLB hit or a walk
+    * takes nothing else. It is taken before the mmvm_lock, which
+    * guards the frames, the page lists and the swap devices. Under
+    * the mmvm_lock, the page table of another mm is only reached
+    * through a trylock of its lock: reclaim, KSM, zswap write back.
+    * The lock is recursive, the other mm may be the own one */
+   uint32_t users;            /* processes running in it */
+   pthread_mutex_t lock;
+#else
    /* list of free page */
    struct pgn_t *fifo_pgn;
+#endif
 };
 
 /*
@@ -116,14 +314,29 @@ struct memphy_struct {
    /* Basic field of data and size */
    BYTE *storage;
    addr_t maxsz;
+   char *path;             /* backing host file, NULL if anonymous */
    
    /* Sequential device fields */ 
    int rdmflg;
-   int cursor;
+   addr_t cursor;
+
+   /* Simulated cost of a sequential device, in ns: moving the cursor
+    * costs seek_ns plus seek_ns_per_mb by distance, every byte moved
+    * costs xfer_ns_per_kb / 1024. Nothing is slept, busy_ns adds up */
+   uint64_t seek_ns;
+   uint64_t seek_ns_per_mb;
+   uint64_t xfer_ns_per_kb;
+   uint64_t busy_ns;
+   uint64_t nseek;
 
    /* Management structure */
-   struct framephy_struct *free_fp_list;
-   struct framephy_struct *used_fp_list;
+   addr_t *free_fp_stack;  /* free frame numbers, top at [free_fp_top - 1] */
+   addr_t free_fp_top;
+   addr_t *free_fp_pos;    /* stack index of a free frame, FRAME_NIL if used */
+   uint64_t *free_fp_map;  /* one bit per frame, set while it is free */
+   addr_t clust_next;      /* next cluster MEMPHY_get_freefp_near tries */
+   addr_t numfp;
+   struct framedesc_t *fdesc;  /* numfp entries */
 };
 
 #endif
@@ -0,0 +1,42 @@
+#ifndef OS_H
+#define OS_H
+
+#include "common.h"
+#include "evlog.h"
+
+/* Processes waiting to be loaded, read from the configure file */
+struct ld_args{
+	char ** path;
+	unsigned long * start_time;
+#ifdef MLQ_SCHED
+	unsigned long * prio;
+#endif
+	int num_processes;
+	int next;	/* index of the next process to be loaded */
+#ifdef MM_PAGING
+	int memramsz;
+	int memswpsz[PAGING_MAX_MMSWP];
+	char * memswpfile[PAGING_MAX_MMSWP];	/* host file, NULL if anonymous */
+	int memswpprio[PAGING_MAX_MMSWP];
+#endif
+};
+
+/* Simulation options */
+struct os_opts_t {
+	int log_mode;			/* EVLOG_TEXT, EVLOG_BINARY, EVLOG_QUIET */
+	const char * log_path;		/* binary event log of EVLOG_BINARY */
+	const char * ckpt_path;		/* snapshot to take, NULL if none */
+	uint64_t ckpt_time;		/* time slot the snapshot resumes at */
+	const char * restore_path;	/* snapshot to restore instead of a config */
+	int time_slot;			/* overrides on restore, 0 to keep */
+	int num_cpus;
+};
+
+/* Run a whole simulation described by the configure file at [path],
+ * or resumed from [opts->restore_path].
+ * The kernel instance is private to the call, so independent
+ * simulations may run concurrently in different host threads.
+ * Return 0 on success, -1 if the configure file cannot be read */
+int os_simulate(const char * path, struct os_opts_t * opts);
+
+#endif
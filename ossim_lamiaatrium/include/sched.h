@@ -1,25 +1,31 @@
 #ifndef SCHED_H
 #define SCHED_H
 
-#include "common.h"
+/* This header shadows the libc <sched.h> that <pthread.h> pulls in,
+ * so it must not include common.h: forward declare what we need */
+#include <stdint.h>
 
 #ifndef MLQ_SCHED
-#define MLQ_SCHED
+#define MLQ_SCHED 1
 #endif
 
 #define MAX_PRIO 140
 
-int queue_empty(void);
+struct krnl_t;
+struct pcb_t;
 
-void init_scheduler(void);
-void finish_scheduler(void);
+int queue_empty(struct krnl_t * krnl);
+int running_procs(struct krnl_t * krnl);
 
-struct pcb_t * get_proc(void);
-void put_proc(struct pcb_t * proc);
-void add_proc(struct pcb_t * proc);
+void init_scheduler(struct krnl_t * krnl);
+void finish_scheduler(struct krnl_t * krnl);
 
-struct pcb_t * get_proc_by_pid(int pid);
-void finish_proc(struct pcb_t * proc);
+struct pcb_t * get_proc(struct krnl_t * krnl);
+void put_proc(struct krnl_t * krnl, struct pcb_t * proc);
+void add_proc(struct krnl_t * krnl, struct pcb_t * proc);
+
+struct pcb_t * get_proc_by_pid(struct krnl_t * krnl, int pid);
+void finish_proc(struct krnl_t * krnl, struct pcb_t * proc);
 
 struct pcb_t *find_process_by_pid(struct krnl_t *krnl, uint32_t pid);
 
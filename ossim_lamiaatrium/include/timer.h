@@ -7,22 +7,47 @@
 struct timer_id_t {
 	int done;
 	int fsh;
+	int daemon;	/* does not keep the timer alive, see attach_daemon */
 	pthread_cond_t event_cond;
 	pthread_mutex_t event_lock;
 	pthread_cond_t timer_cond;
 	pthread_mutex_t timer_lock;
 };
 
-void start_timer();
+struct timer_id_container_t;
+
+/* Timer instance, one per simulated kernel */
+struct sys_timer_t {
+	pthread_t thread;
+	struct timer_id_container_t * dev_list;
+	uint64_t time;
+	int started;
+	int stop;
+	struct evlog_t * log;
+
+	/* Called once per slot after the time advanced, while every
+	 * device is still parked in next_slot() */
+	void (*on_slot)(struct sys_timer_t * timer, void * arg);
+	void * on_slot_arg;
+};
+
+void init_timer(struct sys_timer_t * timer);
+
+void start_timer(struct sys_timer_t * timer);
+
+void stop_timer(struct sys_timer_t * timer);
 
-void stop_timer();
+struct timer_id_t * attach_event(struct sys_timer_t * timer);
 
-struct timer_id_t * attach_event();
+/* A daemon device runs every slot like any other one, but the timer
+ * stops once all the other devices are detached. The daemon then finds
+ * its fsh set when next_slot() returns */
+struct timer_id_t * attach_daemon(struct sys_timer_t * timer);
 
 void detach_event(struct timer_id_t * event);
 
 void next_slot(struct timer_id_t* timer_id);
 
-uint64_t current_time();
+uint64_t current_time(struct sys_timer_t * timer);
 
 #endif
@@ -0,0 +1,1140 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+
+/*
+ * Simulation snapshot
+ * ckpt.c
+ */
+
+#include "ckpt.h"
+#include "os.h"
+#include "queue.h"
+#include "sched.h"
+#include "mm.h"
+#include "mm64.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CKPT_MAX_PROCS (MAX_QUEUE_SIZE * (MAX_PRIO + 3))
+#define CKPT_MAX_LIST (1 << 24)
+#define CKPT_END (~(uint64_t)0)	/* end of a list */
+#define CKPT_MAX_PATH 4096
+/* Memory images start on this boundary, a multiple of the host page
+ * sizes, so that the restore can map them */
+#define CKPT_ALIGN ((uint64_t)1 << 16)
+#define CKPT_ALIGN_UP(x) (((x) + CKPT_ALIGN - 1) & ~(CKPT_ALIGN - 1))
+#ifdef MM64
+#define CKPT_PAGESZ PAGING64_PAGESZ
+#else
+#define CKPT_PAGESZ PAGING_PAGESZ
+#endif
+
+/* Memory is saved with the 64-bit paging only, the 32-bit page tables
+ * have no snapshot layout and ckpt_save/ckpt_restore refuse them */
+#if defined(MM_PAGING) && defined(MM64)
+#define CKPT_MM
+#elif defined(MM_PAGING)
+#define CKPT_NO_MM
+#endif
+
+struct ckpt_hdr_t {
+	char magic[8];
+	uint32_t pagesz;
+	uint32_t max_prio;
+	uint32_t max_mmswp;
+	uint32_t max_queue;
+	uint64_t time;
+	int32_t time_slot;
+	int32_t num_cpus;
+	int32_t done;
+	uint32_t avail_pid;
+	int32_t current_prio;
+	uint32_t active_mswp_id;
+	int32_t mswp_prio[PAGING_MAX_MMSWP];
+	char mm_policy[16];
+};
+
+/*
+ * Small stream helpers, errors are sticky on the FILE and checked
+ * once at the end with ferror()/feof()
+ */
+static void ck_put(FILE *f, const void *p, size_t sz)
+{
+	if (sz > 0)
+		fwrite(p, 1, sz, f);
+}
+
+static int ck_get(FILE *f, void *p, size_t sz)
+{
+	if (sz == 0)
+		return 0;
+	return (fread(p, 1, sz, f) == sz) ? 0 : -1;
+}
+
+static void ck_put_u64(FILE *f, uint64_t v)
+{
+	ck_put(f, &v, sizeof(v));
+}
+
+static int ck_get_u64(FILE *f, uint64_t *v)
+{
+	return ck_get(f, v, sizeof(*v));
+}
+
+/* Read a count and refuse anything above [max] */
+static int ck_get_cnt(FILE *f, uint64_t max, uint64_t *v)
+{
+	if (ck_get_u64(f, v) != 0 || *v > max)
+		return -1;
+	return 0;
+}
+
+static void ck_put_str(FILE *f, const char *s)
+{
+	uint64_t len = (s != NULL) ? strlen(s) : 0;
+	ck_put_u64(f, len);
+	ck_put(f, s, len);
+}
+
+static char *ck_get_str(FILE *f, uint64_t max)
+{
+	uint64_t len;
+	char *s;
+
+	if (ck_get_cnt(f, max, &len) != 0)
+		return NULL;
+	s = malloc(max + 1);
+	if (s == NULL || ck_get(f, s, len) != 0) {
+		free(s);
+		return NULL;
+	}
+	s[len] = '\0';
+	return s;
+}
+
+/*
+ * Process table: every live PCB sits in running_list or in one of the
+ * ready queues, collect them once each
+ */
+static int ck_add_proc(struct pcb_t **tbl, int n, struct pcb_t *proc)
+{
+	int i;
+	if (proc == NULL)
+		return n;
+	for (i = 0; i < n; i++)
+		if (tbl[i] == proc)
+			return n;
+	tbl[n] = proc;
+	return n + 1;
+}
+
+static int ck_add_queue(struct pcb_t **tbl, int n, struct queue_t *q)
+{
+	int i;
+	for (i = 0; i < q->size; i++)
+		n = ck_add_proc(tbl, n, q->proc[i]);
+	return n;
+}
+
+static struct pcb_t *ck_find_pid(struct pcb_t **tbl, int n, uint64_t pid)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		if (tbl[i]->pid == pid)
+			return tbl[i];
+	return NULL;
+}
+
+static void ck_put_queue(FILE *f, struct queue_t *q)
+{
+	int i;
+	ck_put_u64(f, q->size);
+	for (i = 0; i < q->size; i++)
+		ck_put_u64(f, q->proc[i]->pid);
+}
+
+static int ck_get_queue(FILE *f, struct queue_t *q, struct pcb_t **tbl, int n)
+{
+	uint64_t size, pid, i;
+
+	if (ck_get_cnt(f, MAX_QUEUE_SIZE, &size) != 0)
+		return -1;
+	for (i = 0; i < size; i++) {
+		if (ck_get_u64(f, &pid) != 0)
+			return -1;
+		if ((q->proc[i] = ck_find_pid(tbl, n, pid)) == NULL)
+			return -1;
+	}
+	q->size = size;
+	return 0;
+}
+
+#ifdef CKPT_MM
+/*
+ * Memory map of one process, the page table is saved as the list of
+ * its nonzero PTEs and rebuilt with pgtbl_store()
+ */
+static int ck_put_pte(addr_t pgn, uint64_t pte, void *arg)
+{
+	FILE *f = (FILE *)arg;
+	ck_put_u64(f, pgn);
+	ck_put_u64(f, pte);
+	return 0;
+}
+
+static int ck_count_pte(addr_t pgn, uint64_t pte, void *arg)
+{
+	(*(uint64_t *)arg)++;
+	return 0;
+}
+
+static void ck_put_mm(FILE *f, struct mm_struct *mm)
+{
+	struct vm_area_struct *vma;
+	struct vm_rg_struct *rg;
+	uint64_t cnt;
+	int i;
+
+	cnt = 0;
+	pgtbl_for_each(mm, ck_count_pte, &cnt);
+	ck_put_u64(f, cnt);
+	pgtbl_for_each(mm, ck_put_pte, f);
+
+	for (cnt = 0, vma = mm->mmap; vma != NULL; vma = vma->vm_next)
+		cnt++;
+	ck_put_u64(f, cnt);
+	for (vma = mm->mmap; vma != NULL; vma = vma->vm_next) {
+		ck_put_u64(f, vma->vm_id);
+		ck_put_u64(f, vma->vm_start);
+		ck_put_u64(f, vma->vm_end);
+		ck_put_u64(f, vma->sbrk);
+		for (cnt = 0, rg = vma->vm_freerg_list; rg != NULL; rg = rg->rg_next)
+			cnt++;
+		ck_put_u64(f, cnt);
+		for (rg = vma->vm_freerg_list; rg != NULL; rg = rg->rg_next) {
+			ck_put_u64(f, rg->rg_start);
+			ck_put_u64(f, rg->rg_end);
+		}
+	}
+
+	for (i = 0; i < PAGING_MAX_SYMTBL_SZ; i++) {
+		ck_put_u64(f, mm->symrgtbl[i].rg_start);
+		ck_put_u64(f, mm->symrgtbl[i].rg_end);
+	}
+
+	/* The page list links live in the RAM frame descriptors */
+	for (i = 0; i < MM_NR_PGLIST; i++) {
+		ck_put_u64(f, mm->pglist[i].head);
+		ck_put_u64(f, mm->pglist[i].tail);
+		ck_put_u64(f, mm->pglist[i].nr);
+	}
+
+	ck_put_u64(f, mm->activity);
+
+	/* ARC ghosts, oldest first so the restore can push them back */
+	ck_put_u64(f, mm->arc != NULL);
+	if (mm->arc != NULL) {
+		struct arc_ghost_t *g;
+		ck_put_u64(f, mm->arc->p);
+		for (i = 0; i < 2; i++) {
+			ck_put_u64(f, mm->arc->nr[i]);
+			for (g = mm->arc->tail[i]; g != NULL; g = g->prev)
+				ck_put_u64(f, g->pgn);
+		}
+	}
+}
+
+static int ck_get_mm(FILE *f, struct mm_struct *mm)
+{
+	struct vm_area_struct **vmap;
+	struct vm_rg_struct **rgp;
+	uint64_t nvma, nrg, npte, pgn, v, i, j;
+
+	memset(mm, 0, sizeof(struct mm_struct));
+	if (ck_get_cnt(f, CKPT_MAX_LIST, &npte) != 0)
+		return -1;
+	for (i = 0; i < npte; i++) {
+		if (ck_get_u64(f, &pgn) != 0 || ck_get_u64(f, &v) != 0 ||
+		    pgtbl_store(mm, pgn, v) != 0)
+			return -1;
+	}
+	if (mm->pgd == NULL) {
+		mm->pgd = calloc(1, sizeof(struct pgtbl64_t));
+		mm->nr_pgtbl = 1;
+	}
+
+	if (ck_get_cnt(f, CKPT_MAX_LIST, &nvma) != 0)
+		return -1;
+	vmap = &mm->mmap;
+	for (i = 0; i < nvma; i++) {
+		struct vm_area_struct *vma = calloc(1, sizeof(struct vm_area_struct));
+		*vmap = vma;
+		vmap = &vma->vm_next;
+		vma->vm_mm = mm;
+		if (ck_get_u64(f, &v) != 0) return -1;
+		vma->vm_id = v;
+		if (ck_get_u64(f, &v) != 0) return -1;
+		vma->vm_start = v;
+		if (ck_get_u64(f, &v) != 0) return -1;
+		vma->vm_end = v;
+		if (ck_get_u64(f, &v) != 0) return -1;
+		vma->sbrk = v;
+
+		if (ck_get_cnt(f, CKPT_MAX_LIST, &nrg) != 0)
+			return -1;
+		rgp = &vma->vm_freerg_list;
+		for (j = 0; j < nrg; j++) {
+			uint64_t start, end;
+			if (ck_get_u64(f, &start) != 0 || ck_get_u64(f, &end) != 0)
+				return -1;
+			*rgp = init_vm_rg(start, end);
+			rgp = &(*rgp)->rg_next;
+		}
+	}
+
+	for (i = 0; i < PAGING_MAX_SYMTBL_SZ; i++) {
+		if (ck_get_u64(f, &v) != 0) return -1;
+		mm->symrgtbl[i].rg_start = v;
+		if (ck_get_u64(f, &v) != 0) return -1;
+		mm->symrgtbl[i].rg_end = v;
+	}
+
+	for (i = 0; i < MM_NR_PGLIST; i++) {
+		if (ck_get_u64(f, &mm->pglist[i].head) != 0 ||
+		    ck_get_u64(f, &mm->pglist[i].tail) != 0 ||
+		    ck_get_u64(f, &mm->pglist[i].nr) != 0)
+			return -1;
+	}
+
+	if (ck_get_u64(f, &v) != 0)
+		return -1;
+	mm->activity = v;
+
+	if (ck_get_u64(f, &v) != 0)
+		return -1;
+	if (v) {
+		struct arc_t *arc = arc_get(mm);
+		if (arc == NULL || ck_get_u64(f, &arc->p) != 0)
+			return -1;
+		for (i = 0; i < 2; i++) {
+			if (ck_get_cnt(f, CKPT_MAX_LIST, &nrg) != 0)
+				return -1;
+			for (j = 0; j < nrg; j++) {
+				if (ck_get_u64(f, &pgn) != 0 ||
+				    arc_ghost_push(arc, i, pgn) != 0)
+					return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Free what ck_get_mm rebuilt of a snapshot that fails to restore,
+ * the frames go with the devices
+ */
+static void ck_free_mm(struct mm_struct *mm)
+{
+	struct vm_area_struct *vma;
+	struct vm_rg_struct *rg;
+
+	while ((vma = mm->mmap) != NULL) {
+		mm->mmap = vma->vm_next;
+		while ((rg = vma->vm_freerg_list) != NULL) {
+			vma->vm_freerg_list = rg->rg_next;
+			free(rg);
+		}
+		free(vma);
+	}
+	/* The policy may not be set yet, ghost lists are ARC only */
+	if (mm->arc != NULL)
+		mm_policy_get("arc")->release(mm);
+	pgtbl_free(mm);
+	free(mm);
+}
+#endif
+
+/*
+ * Undo ck_get_pcb, an mm goes with the last PCB using it
+ */
+static void ck_free_pcb(struct krnl_t *krnl, struct pcb_t *proc)
+{
+#ifdef CKPT_MM
+	if (proc->mm != NULL && --proc->mm->users == 0) {
+		mm_unlink(krnl, proc->mm);
+		pthread_mutex_destroy(&proc->mm->lock);
+		ck_free_mm(proc->mm);
+	}
+#endif
+	if (proc->code != NULL)
+		free(proc->code->text);
+	free(proc->code);
+	free(proc->page_table);
+	free(proc);
+}
+
+/*
+ * Process control block with its code segment. The mm of a thread is
+ * saved with the first PCB using it, the others only give that PID
+ */
+static void ck_put_pcb(FILE *f, struct pcb_t *proc, struct pcb_t **tbl, int n)
+{
+#ifdef CKPT_MM
+	int i;
+#endif
+
+	ck_put_u64(f, proc->pid);
+	ck_put_u64(f, proc->priority);
+#ifdef MLQ_SCHED
+	ck_put_u64(f, proc->prio);
+#else
+	ck_put_u64(f, 0);
+#endif
+	ck_put_u64(f, proc->pc);
+	ck_put_u64(f, proc->bp);
+	ck_put(f, proc->regs, sizeof(proc->regs));
+	ck_put_str(f, proc->path);
+	ck_put_u64(f, proc->code->size);
+	ck_put(f, proc->code->text, proc->code->size * sizeof(struct inst_t));
+#ifdef CKPT_MM
+	for (i = 0; i < n && tbl[i]->mm != proc->mm; i++)
+		;
+	if (proc->mm != NULL && i < n) {
+		ck_put_u64(f, 2);
+		ck_put_u64(f, tbl[i]->pid);
+		return;
+	}
+	ck_put_u64(f, proc->mm != NULL);
+	if (proc->mm != NULL)
+		ck_put_mm(f, proc->mm);
+#endif
+}
+
+static struct pcb_t *ck_get_pcb(FILE *f, struct krnl_t *krnl,
+                               struct pcb_t **tbl, int n)
+{
+	struct pcb_t *proc = calloc(1, sizeof(struct pcb_t));
+	uint64_t v;
+	char *path;
+
+	proc->krnl = krnl;
+	proc->page_table = calloc(1, sizeof(struct page_table_t));
+	proc->code = calloc(1, sizeof(struct code_seg_t));
+	if (ck_get_u64(f, &v) != 0) goto fail;
+	proc->pid = v;
+	if (ck_get_u64(f, &v) != 0) goto fail;
+	proc->priority = v;
+	if (ck_get_u64(f, &v) != 0) goto fail;
+#ifdef MLQ_SCHED
+	proc->prio = v;
+#endif
+	if (ck_get_u64(f, &v) != 0) goto fail;
+	proc->pc = v;
+	if (ck_get_u64(f, &v) != 0) goto fail;
+	proc->bp = v;
+	if (ck_get(f, proc->regs, sizeof(proc->regs)) != 0)
+		goto fail;
+	if ((path = ck_get_str(f, sizeof(proc->path) - 1)) == NULL)
+		goto fail;
+	strcpy(proc->path, path);
+	free(path);
+
+	if (ck_get_cnt(f, CKPT_MAX_LIST, &v) != 0 || v < proc->pc)
+		goto fail;
+	proc->code->size = v;
+	proc->code->text = malloc(v * sizeof(struct inst_t));
+	if (ck_get(f, proc->code->text, v * sizeof(struct inst_t)) != 0)
+		goto fail;
+#ifdef CKPT_MM
+	if (ck_get_u64(f, &v) != 0)
+		goto fail;
+	if (v == 2) {
+		struct pcb_t *owner;
+		if (ck_get_u64(f, &v) != 0 ||
+		    (owner = ck_find_pid(tbl, n, v)) == NULL || owner->mm == NULL)
+			goto fail;
+		proc->mm = owner->mm;
+		proc->mm->users++;
+	} else if (v) {
+		proc->mm = malloc(sizeof(struct mm_struct));
+		if (ck_get_mm(f, proc->mm) != 0) {
+			ck_free_mm(proc->mm);
+			proc->mm = NULL;
+			goto fail;
+		}
+		proc->mm->asid = proc->pid;
+		proc->mm->frm_mp = krnl->mram;
+		proc->mm->policy = krnl->mm_policy;
+		proc->mm->users = 1;
+		mm_lock_init(proc->mm);
+		mm_link(krnl, proc->mm);
+	}
+#endif
+	return proc;
+
+fail:
+	ck_free_pcb(krnl, proc);
+	return NULL;
+}
+
+#ifdef CKPT_MM
+/*
+ * Physical memory device, frame lists are saved as frame numbers and
+ * the owner of a used frame as the PID of the process owning the mm.
+ * The storage follows as an image on a CKPT_ALIGN boundary
+ */
+static uint64_t ck_mm_pid(struct pcb_t **tbl, int n, struct mm_struct *mm)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		if (mm != NULL && tbl[i]->mm == mm)
+			return tbl[i]->pid;
+	return 0;
+}
+
+static int ck_zero_page(BYTE *pg, uint64_t len)
+{
+	return pg[0] == 0 && memcmp(pg, pg + 1, len - 1) == 0;
+}
+
+static void ck_put_memphy(FILE *f, struct memphy_struct *mp,
+                          struct pcb_t **tbl, int n)
+{
+	uint64_t cnt, off, i;
+	long at;
+
+	ck_put_u64(f, mp->maxsz);
+	ck_put_u64(f, mp->rdmflg);
+	ck_put_u64(f, mp->cursor);
+	ck_put_u64(f, mp->busy_ns);
+	ck_put_u64(f, mp->nseek);
+	ck_put_str(f, mp->path);
+	/* Offset of the image, filled in once the frame lists are out */
+	at = ftell(f);
+	ck_put_u64(f, 0);
+
+	ck_put_u64(f, mp->numfp);
+	ck_put_u64(f, mp->free_fp_top);
+	for (i = 0; i < mp->free_fp_top; i++)
+		ck_put_u64(f, mp->free_fp_stack[i]);
+
+	/* Descriptors of the frames on a FIFO, with their links */
+	for (cnt = 0, i = 0; i < mp->numfp; i++)
+		if (mp->fdesc[i].owner != NULL)
+			cnt++;
+	ck_put_u64(f, cnt);
+	for (i = 0; i < mp->numfp; i++) {
+		struct framedesc_t *fd = &mp->fdesc[i];
+		if (fd->owner == NULL)
+			continue;
+		ck_put_u64(f, i);
+		ck_put_u64(f, ck_mm_pid(tbl, n, fd->owner));
+		ck_put_u64(f, fd->pgn);
+		ck_put_u64(f, fd->prev);
+		ck_put_u64(f, fd->next);
+		ck_put_u64(f, fd->list);
+		ck_put_u64(f, fd->age);
+	}
+
+	/* Zero pages are skipped over and stay holes of the file */
+	off = CKPT_ALIGN_UP((uint64_t)ftell(f));
+	for (i = 0; i < mp->maxsz; i += CKPT_PAGESZ) {
+		uint64_t len = (mp->maxsz - i < CKPT_PAGESZ) ? mp->maxsz - i : CKPT_PAGESZ;
+		if (ck_zero_page(mp->storage + i, len))
+			continue;
+		fseek(f, off + i, SEEK_SET);
+		ck_put(f, mp->storage + i, len);
+	}
+	fseek(f, at, SEEK_SET);
+	ck_put_u64(f, off);
+	fseek(f, off + mp->maxsz, SEEK_SET);
+}
+
+/*
+ * Map the image of a device. A device backed by a host file gets the
+ * file back with the image copied in, or stays on the snapshot if the
+ * file cannot be opened any more
+ */
+static int ck_get_image(FILE *f, struct memphy_struct *mp, uint64_t maxsz,
+                        uint64_t rdmflg, const char *path, uint64_t off)
+{
+	struct stat st;
+	uint64_t len, i;
+	BYTE *img;
+	int fd = fileno(f);
+
+	if (off % CKPT_ALIGN != 0 || fstat(fd, &st) != 0 ||
+	    (uint64_t)st.st_size < off + maxsz)
+		return -1;
+	if (path[0] == '\0' || init_memphy_file(mp, maxsz, rdmflg, path) != 0)
+		return init_memphy_image(mp, maxsz, rdmflg, fd, off);
+	if (maxsz == 0)
+		return 0;
+
+	img = mmap(NULL, maxsz, PROT_READ, MAP_PRIVATE, fd, off);
+	if (img == MAP_FAILED) {
+		free_memphy(mp);
+		return -1;
+	}
+	/* Holes stay holes, older data of the file is cleared */
+	for (i = 0; i < maxsz; i += CKPT_PAGESZ) {
+		len = (maxsz - i < CKPT_PAGESZ) ? maxsz - i : CKPT_PAGESZ;
+		if (!ck_zero_page(img + i, len))
+			memcpy(mp->storage + i, img + i, len);
+		else if (!ck_zero_page(mp->storage + i, len))
+			memset(mp->storage + i, 0, len);
+	}
+	munmap(img, maxsz);
+	return 0;
+}
+
+static int ck_get_memphy(FILE *f, struct memphy_struct *mp,
+                         struct pcb_t **tbl, int n)
+{
+	uint64_t maxsz, rdmflg, cursor, busy_ns, nseek, off, cnt, v, i, j;
+	char *path;
+	int ret = -1;
+
+	memset(mp, 0, sizeof(struct memphy_struct));
+	if (ck_get_cnt(f, (uint64_t)1 << 40, &maxsz) != 0 ||
+	    ck_get_u64(f, &rdmflg) != 0 || ck_get_u64(f, &cursor) != 0 ||
+	    ck_get_u64(f, &busy_ns) != 0 || ck_get_u64(f, &nseek) != 0)
+		return -1;
+	if ((path = ck_get_str(f, CKPT_MAX_PATH)) == NULL)
+		return -1;
+	if (ck_get_u64(f, &off) == 0)
+		ret = ck_get_image(f, mp, maxsz, rdmflg, path, off);
+	free(path);
+	if (ret != 0)
+		return -1;
+	mp->cursor = cursor;
+	mp->busy_ns = busy_ns;
+	mp->nseek = nseek;
+
+	if (ck_get_u64(f, &v) != 0 || v != mp->numfp)
+		return -1;
+	if (ck_get_cnt(f, mp->numfp, &cnt) != 0)
+		return -1;
+	/* Pushed back in the same order, the stack comes out the same */
+	MEMPHY_clear_freefp(mp);
+	for (i = 0; i < cnt; i++) {
+		if (ck_get_u64(f, &v) != 0 || MEMPHY_put_freefp(mp, v) != 0)
+			return -1;
+	}
+
+	if (ck_get_cnt(f, mp->numfp, &cnt) != 0)
+		return -1;
+	for (j = 0; j < cnt; j++) {
+		struct framedesc_t *fd;
+		struct pcb_t *proc;
+		uint64_t pid;
+		if (ck_get_u64(f, &v) != 0 || v >= mp->numfp ||
+		    ck_get_u64(f, &pid) != 0)
+			return -1;
+		fd = &mp->fdesc[v];
+		if (ck_get_u64(f, &fd->pgn) != 0 || ck_get_u64(f, &fd->prev) != 0 ||
+		    ck_get_u64(f, &fd->next) != 0)
+			return -1;
+		if (ck_get_u64(f, &v) != 0 || v >= MM_NR_PGLIST)
+			return -1;
+		fd->list = v;
+		if (ck_get_u64(f, &v) != 0)
+			return -1;
+		fd->age = v;
+		if ((proc = ck_find_pid(tbl, n, pid)) == NULL || proc->mm == NULL)
+			return -1;
+		fd->owner = proc->mm;
+	}
+
+	/* Go on past the image */
+	return (fseek(f, off + maxsz, SEEK_SET) == 0) ? 0 : -1;
+}
+
+/*
+ * Compressed swap cache, the pool frames themselves are saved with
+ * the RAM. Entries go from the oldest to the newest, the PTEs refer
+ * to them by index
+ */
+static void ck_put_zswap(FILE *f, struct zswap_t *zs,
+                         struct pcb_t **tbl, int n)
+{
+	uint64_t cnt, i;
+
+	ck_put_u64(f, zs != NULL);
+	if (zs == NULL)
+		return;
+	ck_put_u64(f, zs->nr_store);
+	ck_put_u64(f, zs->nr_reject);
+	ck_put_u64(f, zs->nr_nomem);
+	ck_put_u64(f, zs->nr_load);
+	ck_put_u64(f, zs->nr_writeback);
+	ck_put_u64(f, zs->bytes_stored);
+
+	ck_put_u64(f, zs->npool);
+	for (i = 0; i < zs->npool; i++) {
+		ck_put_u64(f, zs->pool[i]);
+		ck_put_u64(f, zs->map[i]);
+	}
+
+	for (cnt = 0, i = zs->lru_tail; i != FRAME_NIL; i = zs->ent[i].prev)
+		cnt++;
+	ck_put_u64(f, cnt);
+	for (i = zs->lru_tail; i != FRAME_NIL; i = zs->ent[i].prev) {
+		struct zswap_entry_t *e = &zs->ent[i];
+		ck_put_u64(f, i);
+		ck_put_u64(f, ck_mm_pid(tbl, n, e->owner));
+		ck_put_u64(f, e->pgn);
+		ck_put_u64(f, e->fpn);
+		ck_put_u64(f, e->chunk);
+		ck_put_u64(f, e->len);
+	}
+}
+
+static int ck_get_zswap(FILE *f, struct krnl_t *krnl,
+                        struct pcb_t **tbl, int n)
+{
+	struct zswap_t *zs;
+	uint64_t cnt, v, i, j;
+
+	if (ck_get_u64(f, &v) != 0)
+		return -1;
+	if (v == 0)
+		return 0;
+	zs = krnl->zswap = malloc(sizeof(struct zswap_t));
+	if (zs == NULL || zswap_init(zs, krnl->mram->numfp) != 0)
+		return -1;
+	if (ck_get_u64(f, &zs->nr_store) != 0 ||
+	    ck_get_u64(f, &zs->nr_reject) != 0 ||
+	    ck_get_u64(f, &zs->nr_nomem) != 0 ||
+	    ck_get_u64(f, &zs->nr_load) != 0 ||
+	    ck_get_u64(f, &zs->nr_writeback) != 0 ||
+	    ck_get_u64(f, &zs->bytes_stored) != 0)
+		return -1;
+
+	if (ck_get_cnt(f, zs->maxpool, &cnt) != 0)
+		return -1;
+	zs->npool = cnt;
+	for (i = 0; i < zs->npool; i++) {
+		if (ck_get_u64(f, &zs->pool[i]) != 0 ||
+		    zs->pool[i] >= krnl->mram->numfp || ck_get_u64(f, &v) != 0)
+			return -1;
+		zs->map[i] = v;
+	}
+
+	if (ck_get_cnt(f, zs->nent, &cnt) != 0)
+		return -1;
+	for (j = 0; j < cnt; j++) {
+		struct zswap_entry_t *e;
+		struct pcb_t *proc;
+		uint64_t pid, chunk, len;
+		if (ck_get_u64(f, &i) != 0 || i >= zs->nent ||
+		    zs->ent[i].owner != NULL || ck_get_u64(f, &pid) != 0)
+			return -1;
+		e = &zs->ent[i];
+		if (ck_get_u64(f, &e->pgn) != 0 || ck_get_u64(f, &e->fpn) != 0 ||
+		    ck_get_u64(f, &chunk) != 0 || ck_get_u64(f, &len) != 0 ||
+		    chunk >= ZSWAP_NCHUNK || len > CKPT_PAGESZ)
+			return -1;
+		e->chunk = chunk;
+		e->len = len;
+		if ((proc = ck_find_pid(tbl, n, pid)) == NULL || proc->mm == NULL)
+			return -1;
+		e->owner = proc->mm;
+		zswap_lru_push(zs, i);
+	}
+	zswap_relink(zs);
+	return 0;
+}
+
+/*
+ * Same page merging, only where ksmd is. The shared frames are found
+ * again by the COW bit of their PTEs and the checksums are taken anew
+ */
+static void ck_put_ksm(FILE *f, struct ksm_t *ks)
+{
+	ck_put_u64(f, ks != NULL);
+	if (ks == NULL)
+		return;
+	ck_put_u64(f, ks->cursor);
+	ck_put_u64(f, ks->nr_merge);
+	ck_put_u64(f, ks->nr_zero);
+	ck_put_u64(f, ks->nr_pass);
+	ck_put_u64(f, ks->max_saved);
+}
+
+static int ck_get_ksm(FILE *f, struct krnl_t *krnl)
+{
+	struct ksm_t *ks;
+	uint64_t v;
+
+	if (ck_get_u64(f, &v) != 0)
+		return -1;
+	if (v != 0) {
+		ks = krnl->ksm = malloc(sizeof(struct ksm_t));
+		if (ks == NULL || ksm_init(ks, krnl->mram->numfp) != 0)
+			return -1;
+		if (ck_get_cnt(f, ks->nbucket, &ks->cursor) != 0 ||
+		    ck_get_u64(f, &ks->nr_merge) != 0 ||
+		    ck_get_u64(f, &ks->nr_zero) != 0 ||
+		    ck_get_u64(f, &ks->nr_pass) != 0 ||
+		    ck_get_u64(f, &ks->max_saved) != 0)
+			return -1;
+		if (ks->cursor == ks->nbucket)
+			ks->cursor = 0;
+	}
+	return rmap_rebuild(krnl);
+}
+
+/*
+ * Shared memory segments with their frames and mappings, up to
+ * CKPT_END. The PTEs of the mappings are saved with the mm
+ */
+static void ck_put_shm(FILE *f, struct shm_seg_t *shm,
+                       struct pcb_t **tbl, int n)
+{
+	struct shm_attach_t *at;
+	uint64_t i;
+	int sid;
+
+	for (sid = 0; sid < MM_SHM_MAX; sid++) {
+		if (shm[sid].fpn == NULL)
+			continue;
+		ck_put_u64(f, sid);
+		ck_put_u64(f, shm[sid].key);
+		ck_put_u64(f, shm[sid].npages);
+		for (i = 0; i < shm[sid].npages; i++)
+			ck_put_u64(f, shm[sid].fpn[i]);
+		ck_put_u64(f, shm[sid].nattch);
+		for (at = shm[sid].attach; at != NULL; at = at->next) {
+			ck_put_u64(f, ck_mm_pid(tbl, n, at->mm));
+			ck_put_u64(f, at->pgn);
+		}
+	}
+	ck_put_u64(f, CKPT_END);
+}
+
+static int ck_get_shm(FILE *f, struct krnl_t *krnl,
+                      struct pcb_t **tbl, int n)
+{
+	struct memphy_struct *mram = krnl->mram;
+	struct shm_seg_t *seg;
+	uint64_t sid, v, cnt, i;
+
+	krnl->shm = calloc(MM_SHM_MAX, sizeof(struct shm_seg_t));
+	while (ck_get_u64(f, &sid) == 0 && sid != CKPT_END) {
+		if (sid >= MM_SHM_MAX || krnl->shm[sid].fpn != NULL)
+			return -1;
+		seg = &krnl->shm[sid];
+		if (ck_get_u64(f, &v) != 0 ||
+		    ck_get_cnt(f, mram->numfp, &seg->npages) != 0)
+			return -1;
+		seg->key = v;
+		seg->fpn = malloc(seg->npages * sizeof(addr_t));
+		for (i = 0; i < seg->npages; i++) {
+			if (ck_get_u64(f, &v) != 0 || v >= mram->numfp ||
+			    MEMPHY_is_freefp(mram, v))
+				return -1;
+			seg->fpn[i] = v;
+			mram->fdesc[v].shm = sid + 1;
+		}
+		if (ck_get_cnt(f, CKPT_MAX_LIST, &cnt) != 0)
+			return -1;
+		for (i = 0; i < cnt; i++) {
+			struct shm_attach_t *at;
+			struct pcb_t *proc;
+			if (ck_get_u64(f, &v) != 0 ||
+			    (proc = ck_find_pid(tbl, n, v)) == NULL ||
+			    proc->mm == NULL)
+				return -1;
+			at = malloc(sizeof(struct shm_attach_t));
+			at->mm = proc->mm;
+			if (ck_get_u64(f, &at->pgn) != 0) {
+				free(at);
+				return -1;
+			}
+			at->next = seg->attach;
+			seg->attach = at;
+			seg->nattch++;
+		}
+	}
+	return (sid == CKPT_END) ? 0 : -1;
+}
+#endif
+
+/*
+ * ckpt_save - write a snapshot of the kernel instance
+ * @krnl: kernel, every device must be parked in next_slot()
+ * @path: snapshot file
+ */
+int ckpt_save(struct krnl_t *krnl, const char *path)
+{
+	struct ld_args *ld = krnl->ld_processes;
+	struct ckpt_hdr_t hdr;
+	struct pcb_t **tbl;
+	int n = 0, i, ret;
+	char *tmp;
+	FILE *f;
+
+#ifdef CKPT_NO_MM
+	return -1;
+#endif
+	/* Written aside and renamed over [path]: a run restored from
+	 * [path] still maps the images of the old file */
+	tmp = malloc(strlen(path) + sizeof(".tmp"));
+	if (tmp == NULL)
+		return -1;
+	sprintf(tmp, "%s.tmp", path);
+	if ((f = fopen(tmp, "wb")) == NULL) {
+		free(tmp);
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CKPT_MAGIC, sizeof(hdr.magic));
+	hdr.pagesz = CKPT_PAGESZ;
+	hdr.max_prio = MAX_PRIO;
+	hdr.max_mmswp = PAGING_MAX_MMSWP;
+	hdr.max_queue = MAX_QUEUE_SIZE;
+	hdr.time = current_time(&krnl->timer);
+	hdr.time_slot = krnl->time_slot;
+	hdr.num_cpus = krnl->num_cpus;
+	hdr.done = krnl->done;
+	hdr.avail_pid = krnl->avail_pid;
+#ifdef MLQ_SCHED
+	hdr.current_prio = krnl->current_prio;
+#endif
+#ifdef CKPT_MM
+	hdr.active_mswp_id = krnl->active_mswp_id;
+	memcpy(hdr.mswp_prio, krnl->mswp_prio, sizeof(hdr.mswp_prio));
+	strncpy(hdr.mm_policy, krnl->mm_policy->name, sizeof(hdr.mm_policy) - 1);
+#endif
+	ck_put(f, &hdr, sizeof(hdr));
+#ifdef MLQ_SCHED
+	ck_put(f, krnl->slot, sizeof(krnl->slot));
+	ck_put(f, krnl->current_slot, sizeof(krnl->current_slot));
+#endif
+
+	/* Loader, entries before ld->next are already loaded */
+	ck_put_u64(f, ld->num_processes);
+	ck_put_u64(f, ld->next);
+	for (i = ld->next; i < ld->num_processes; i++) {
+		ck_put_u64(f, ld->start_time[i]);
+#ifdef MLQ_SCHED
+		ck_put_u64(f, ld->prio[i]);
+#else
+		ck_put_u64(f, 0);
+#endif
+		ck_put_str(f, ld->path[i]);
+	}
+
+	/* Process table */
+	tbl = malloc(CKPT_MAX_PROCS * sizeof(struct pcb_t *));
+	n = ck_add_queue(tbl, n, krnl->running_list);
+	n = ck_add_queue(tbl, n, krnl->ready_queue);
+	n = ck_add_queue(tbl, n, krnl->run_queue);
+#ifdef MLQ_SCHED
+	for (i = 0; i < MAX_PRIO; i++)
+		n = ck_add_queue(tbl, n, &krnl->mlq_ready_queue[i]);
+#endif
+	ck_put_u64(f, n);
+	for (i = 0; i < n; i++)
+		ck_put_pcb(f, tbl[i], tbl, i);
+
+	/* Scheduler queues and CPUs, by PID */
+	ck_put_queue(f, krnl->running_list);
+	ck_put_queue(f, krnl->ready_queue);
+	ck_put_queue(f, krnl->run_queue);
+#ifdef MLQ_SCHED
+	for (i = 0; i < MAX_PRIO; i++)
+		ck_put_queue(f, &krnl->mlq_ready_queue[i]);
+#endif
+	for (i = 0; i < krnl->num_cpus; i++) {
+		struct cpu_state_t *cpu = &krnl->cpus[i];
+		ck_put_u64(f, (cpu->proc != NULL) ? cpu->proc->pid : 0);
+		ck_put_u64(f, cpu->time_left);
+		ck_put_u64(f, cpu->stopped);
+	}
+
+#ifdef CKPT_MM
+	ck_put_memphy(f, krnl->mram, tbl, n);
+	for (i = 0; i < PAGING_MAX_MMSWP; i++)
+		ck_put_memphy(f, &krnl->mswp[i], tbl, n);
+	ck_put_zswap(f, krnl->zswap, tbl, n);
+	ck_put_ksm(f, krnl->ksm);
+	ck_put_shm(f, krnl->shm, tbl, n);
+#endif
+	free(tbl);
+
+	ret = ferror(f) ? -1 : 0;
+	if (fclose(f) != 0 || ret != 0 || rename(tmp, path) != 0) {
+		remove(tmp);
+		ret = -1;
+	}
+	free(tmp);
+	return ret;
+}
+
+/*
+ * ckpt_restore - rebuild the kernel instance from a snapshot
+ * @krnl: kernel with initialized scheduler and memory devices
+ * @path: snapshot file
+ */
+int ckpt_restore(struct krnl_t *krnl, const char *path)
+{
+	struct ld_args *ld = krnl->ld_processes;
+	struct ckpt_hdr_t hdr;
+	struct pcb_t **tbl = NULL, **gone = NULL;
+	uint64_t cnt, v, t;
+	int n = 0, ngone = 0, i, num_cpus, ret = -1;
+	FILE *f;
+
+#ifdef CKPT_NO_MM
+	return -1;
+#endif
+	if ((f = fopen(path, "rb")) == NULL)
+		return -1;
+
+	if (ck_get(f, &hdr, sizeof(hdr)) != 0 ||
+	    memcmp(hdr.magic, CKPT_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    hdr.pagesz != CKPT_PAGESZ ||
+	    hdr.max_prio != MAX_PRIO || hdr.max_mmswp != PAGING_MAX_MMSWP ||
+	    hdr.max_queue != MAX_QUEUE_SIZE ||
+	    hdr.num_cpus <= 0 || hdr.time_slot <= 0)
+		goto out;
+
+	krnl->timer.time = hdr.time;
+	if (krnl->time_slot <= 0)
+		krnl->time_slot = hdr.time_slot;
+	if (krnl->num_cpus <= 0)
+		krnl->num_cpus = hdr.num_cpus;
+	krnl->done = hdr.done;
+#ifdef CKPT_MM
+	hdr.mm_policy[sizeof(hdr.mm_policy) - 1] = '\0';
+	if ((krnl->mm_policy = mm_policy_get(hdr.mm_policy)) == NULL)
+		goto out;
+#endif
+	krnl->avail_pid = hdr.avail_pid;
+#ifdef MLQ_SCHED
+	krnl->current_prio = hdr.current_prio % MAX_PRIO;
+	if (ck_get(f, krnl->slot, sizeof(krnl->slot)) != 0 ||
+	    ck_get(f, krnl->current_slot, sizeof(krnl->current_slot)) != 0)
+		goto out;
+#endif
+
+	/* Loader */
+	if (ck_get_cnt(f, CKPT_MAX_LIST, &cnt) != 0)
+		goto out;
+	if (ck_get_cnt(f, cnt, &v) != 0)
+		goto out;
+	ld->num_processes = cnt;
+	ld->next = v;
+	ld->path = calloc(cnt, sizeof(char *));
+	ld->start_time = calloc(cnt, sizeof(unsigned long));
+#ifdef MLQ_SCHED
+	ld->prio = calloc(cnt, sizeof(unsigned long));
+#endif
+	for (; v < cnt; v++) {
+		if (ck_get_u64(f, &t) != 0)
+			goto out;
+		ld->start_time[v] = t;
+		if (ck_get_u64(f, &t) != 0)
+			goto out;
+#ifdef MLQ_SCHED
+		ld->prio[v] = t;
+#endif
+		if ((ld->path[v] = ck_get_str(f, 99)) == NULL)
+			goto out;
+	}
+
+	/* Process table */
+	if (ck_get_cnt(f, CKPT_MAX_PROCS, &cnt) != 0)
+		goto out;
+	tbl = calloc(cnt + 1, sizeof(struct pcb_t *));
+	for (n = 0; n < (int)cnt; n++)
+		if ((tbl[n] = ck_get_pcb(f, krnl, tbl, n)) == NULL)
+			goto out;
+
+	/* Scheduler queues and CPUs */
+	if (ck_get_queue(f, krnl->running_list, tbl, n) != 0 ||
+	    ck_get_queue(f, krnl->ready_queue, tbl, n) != 0 ||
+	    ck_get_queue(f, krnl->run_queue, tbl, n) != 0)
+		goto out;
+#ifdef MLQ_SCHED
+	for (i = 0; i < MAX_PRIO; i++)
+		if (ck_get_queue(f, &krnl->mlq_ready_queue[i], tbl, n) != 0)
+			goto out;
+#endif
+
+	num_cpus = krnl->num_cpus;
+	krnl->cpus = calloc(num_cpus, sizeof(struct cpu_state_t));
+#ifdef MM_PAGING
+	for (i = 0; i < num_cpus; i++)
+		tlb_init(&krnl->cpus[i].tlb);
+#endif
+	gone = calloc(hdr.num_cpus, sizeof(struct pcb_t *));
+	for (i = 0; i < hdr.num_cpus; i++) {
+		struct pcb_t *proc;
+		uint64_t stopped;
+		if (ck_get_u64(f, &v) != 0 || ck_get_u64(f, &t) != 0 ||
+		    ck_get_u64(f, &stopped) != 0)
+			goto out;
+		proc = (v != 0) ? ck_find_pid(tbl, n, v) : NULL;
+		if (i < num_cpus) {
+			krnl->cpus[i].proc = proc;
+			krnl->cpus[i].stopped = (stopped != 0);
+			krnl->cpus[i].time_left =
+				((int)t < krnl->time_slot) ? (int)t : krnl->time_slot;
+		} else if (proc != NULL && proc->pc < proc->code->size) {
+			/* Fewer CPUs than before, requeue what the missing
+			 * CPUs were running */
+			put_proc(krnl, proc);
+		} else if (proc != NULL) {
+			/* Its memory is freed once the frames are back */
+			finish_proc(krnl, proc);
+			gone[ngone++] = proc;
+		}
+	}
+
+#ifdef CKPT_MM
+	if (ck_get_memphy(f, krnl->mram, tbl, n) != 0)
+		goto out;
+	for (i = 0; i < PAGING_MAX_MMSWP; i++)
+		if (ck_get_memphy(f, &krnl->mswp[i], tbl, n) != 0)
+			goto out;
+	krnl->active_mswp_id = hdr.active_mswp_id % PAGING_MAX_MMSWP;
+	krnl->active_mswp = &krnl->mswp[krnl->active_mswp_id];
+	memcpy(krnl->mswp_prio, hdr.mswp_prio, sizeof(krnl->mswp_prio));
+	if (ck_get_zswap(f, krnl, tbl, n) != 0 ||
+	    ck_get_ksm(f, krnl) != 0 ||
+	    ck_get_shm(f, krnl, tbl, n) != 0)
+		goto out;
+	for (i = 0; i < ngone; i++)
+		if (gone[i]->mm != NULL)
+			free_pcb_memph(gone[i]);
+#endif
+	for (i = 0; i < ngone; i++)
+		free(gone[i]);
+	ret = 0;
+
+out:
+	/* Nothing restored is run, the devices are freed by the caller */
+	if (ret != 0)
+		while (n > 0)
+			ck_free_pcb(krnl, tbl[--n]);
+	free(gone);
+	free(tbl);
+	fclose(f);
+	return ret;
+}
@@ -92,7 +92,8 @@ switch (ins.opcode)
 	case READ:
 #ifdef MM_PAGING
 		stat = libread(proc, ins.arg_0, ins.arg_1, &val);
-        if (stat == 0) {
+        /* Ignore destinations outside of the register file */
+        if (stat == 0 && ins.arg_2 < sizeof(proc->regs) / sizeof(proc->regs[0])) {
             proc->regs[ins.arg_2] = val;
         }
 #else
@@ -0,0 +1,429 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+/*
+ * Asynchronous binary event log evlog.c
+ */
+
+#include "evlog.h"
+#include "bitops.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+#define EVLOG_RING_MASK (EVLOG_RING_SZ - 1)
+#define EVLOG_TEXT_MAX 1024
+
+/* Only used to tell apart log instances in the thread local cache */
+static _Atomic uint64_t evlog_ids = 1;
+
+static __thread uint64_t tls_log_id;
+static __thread struct evlog_ring_t *tls_ring;
+
+struct evlog_hdr_t {
+	char magic[8];
+	uint32_t recsz;
+	uint32_t nrtypes;
+};
+
+/* Decoder state, gathers the string payload split over several records */
+struct evlog_dec_t {
+	struct evlog_rec_t rec;
+	char str[EVLOG_TEXT_MAX];
+	int len;
+	int pending;
+};
+
+static void evlog_pause(void)
+{
+	struct timespec ts = { 0, 50000 };
+	nanosleep(&ts, NULL);
+}
+
+static void evlog_print(FILE *out, struct evlog_rec_t *rec, const char *str)
+{
+	uint64_t *a = rec->u.arg;
+
+	switch (rec->type) {
+	case EV_TEXT:
+		fputs(str, out);
+		break;
+	case EV_TIME_SLOT:
+		fprintf(out, "Time slot %3lu\n", (unsigned long)a[0]);
+		break;
+	case EV_LD_ROUTINE:
+		fprintf(out, "ld_routine\n");
+		break;
+	case EV_LD_LOADED:
+		fprintf(out, "\tLoaded a process at %s, PID: %d PRIO: %ld\n",
+			str, rec->id, (long)rec->u.s.val);
+		break;
+	case EV_CPU_DISPATCH:
+		fprintf(out, "\tCPU %d: Dispatched process %2d\n", rec->id, (int)a[0]);
+		break;
+	case EV_CPU_PUT:
+		fprintf(out, "\tCPU %d: Put process %2d to run queue\n", rec->id, (int)a[0]);
+		break;
+	case EV_CPU_FINISH:
+		fprintf(out, "\tCPU %d: Processed %2d has finished\n", rec->id, (int)a[0]);
+		break;
+	case EV_CPU_STOP:
+		fprintf(out, "\tCPU %d stopped\n", rec->id);
+		break;
+	case EV_ALLOC:
+		fprintf(out, "liballoc:%d\n", (int)a[0]);
+		break;
+	case EV_FREE:
+		fprintf(out, "libfree:%d\n", (int)a[0]);
+		break;
+	case EV_READ:
+		fprintf(out, "libread:%d\n", (int)a[0]);
+		break;
+	case EV_WRITE:
+		fprintf(out, "libwrite:%d\n", (int)a[0]);
+		break;
+	case EV_PGTBL:
+		fprintf(out, "print_pgtbl:\n PDG=%p P4g=%p PUD=%p PMD=%p\n",
+			(void*)a[0], (void*)a[1], (void*)a[2], (void*)a[3]);
+		break;
+	case EV_FORK:
+		fprintf(out, "\tProcess %2d forked process %2d\n", rec->id, (int)a[0]);
+		break;
+	case EV_CLONE:
+		fprintf(out, "\tProcess %2d started thread %2d\n", rec->id, (int)a[0]);
+		break;
+	case EV_READ_VAL:
+		fprintf(out, "read region=%d offset=%lu value=%d\n",
+			(int)a[0], (unsigned long)a[1], (int)a[2]);
+		break;
+	default:
+		break;
+	}
+}
+
+static void evlog_dec_rec(struct evlog_dec_t *dec, struct evlog_rec_t *rec, FILE *out)
+{
+	char str[EVLOG_STR_SZ + 1];
+
+	if (rec->type == EV_CONT) {
+		if (!dec->pending) return;
+		memcpy(str, rec->u.s.str, EVLOG_STR_SZ);
+		str[EVLOG_STR_SZ] = '\0';
+		if (dec->len + strlen(str) < EVLOG_TEXT_MAX) {
+			strcpy(dec->str + dec->len, str);
+			dec->len += strlen(str);
+		}
+		if (!(rec->flags & EVLOG_F_MORE)) {
+			evlog_print(out, &dec->rec, dec->str);
+			dec->pending = 0;
+		}
+		return;
+	}
+
+	memcpy(str, rec->u.s.str, EVLOG_STR_SZ);
+	str[EVLOG_STR_SZ] = '\0';
+	if (rec->flags & EVLOG_F_MORE) {
+		dec->rec = *rec;
+		strcpy(dec->str, str);
+		dec->len = strlen(str);
+		dec->pending = 1;
+		return;
+	}
+	evlog_print(out, rec, str);
+}
+
+static struct evlog_ring_t *evlog_ring(struct evlog_t *log)
+{
+	struct evlog_ring_t *ring;
+
+	if (tls_ring != NULL && tls_log_id == log->id)
+		return tls_ring;
+
+	ring = calloc(1, sizeof(struct evlog_ring_t));
+	pthread_mutex_lock(&log->rings_lock);
+	ring->next = atomic_load(&log->rings);
+	atomic_store_explicit(&log->rings, ring, memory_order_release);
+	pthread_mutex_unlock(&log->rings_lock);
+
+	tls_log_id = log->id;
+	tls_ring = ring;
+	return ring;
+}
+
+static void evlog_push(struct evlog_ring_t *ring, struct evlog_rec_t *rec)
+{
+	uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+	/* Ring full, wait for the logger to catch up */
+	while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= EVLOG_RING_SZ)
+		evlog_pause();
+
+	ring->rec[head & EVLOG_RING_MASK] = *rec;
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/*
+ * evlog_keep - append a text message to the ones a quiet log prints
+ *              when it stops, they carry the summary statistics
+ */
+static void evlog_keep(struct evlog_t *log, const char *str, size_t len)
+{
+	char *text;
+
+	pthread_mutex_lock(&log->rings_lock);
+	text = realloc(log->text, log->textlen + len + 1);
+	if (text != NULL) {
+		memcpy(text + log->textlen, str, len + 1);
+		log->text = text;
+		log->textlen += len;
+	}
+	pthread_mutex_unlock(&log->rings_lock);
+}
+
+/*
+ * evlog_submit - publish an event whose string payload may span
+ *                several records. The records take consecutive
+ *                sequence numbers so that no other event is merged
+ *                in between.
+ */
+static void evlog_submit(struct evlog_t *log, struct evlog_rec_t *rec, const char *str)
+{
+	size_t len = (str != NULL) ? strlen(str) : 0;
+	int nrec = DIV_ROUND_UP(len, EVLOG_STR_SZ - 1);
+	int i;
+
+	if (nrec == 0) nrec = 1;
+
+	if (log == NULL) {
+		/* No logger attached, print synchronously */
+		evlog_print(stdout, rec, (str != NULL) ? str : "");
+		return;
+	}
+
+	struct evlog_ring_t *ring = evlog_ring(log);
+	ring->count[rec->type]++;
+	if (log->mode == EVLOG_QUIET) {
+		if (rec->type == EV_TEXT && len > 0)
+			evlog_keep(log, str, len);
+		return;
+	}
+
+	uint64_t seq = atomic_fetch_add(&log->seq, nrec);
+	for (i = 0; i < nrec; i++) {
+		if (i > 0) {
+			memset(rec, 0, sizeof(struct evlog_rec_t));
+			rec->type = EV_CONT;
+		}
+		rec->seq = seq + i;
+		rec->flags = (i < nrec - 1) ? EVLOG_F_MORE : 0;
+		if (str != NULL) {
+			strncpy(rec->u.s.str, str + i * (EVLOG_STR_SZ - 1), EVLOG_STR_SZ - 1);
+			rec->u.s.str[EVLOG_STR_SZ - 1] = '\0';
+		}
+		evlog_push(ring, rec);
+	}
+}
+
+void evlog_event(struct evlog_t *log, int type, uint32_t id,
+                 uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3)
+{
+	struct evlog_rec_t rec;
+
+	memset(&rec, 0, sizeof(struct evlog_rec_t));
+	rec.type = type;
+	rec.id = id;
+	rec.u.arg[0] = a0;
+	rec.u.arg[1] = a1;
+	rec.u.arg[2] = a2;
+	rec.u.arg[3] = a3;
+	evlog_submit(log, &rec, NULL);
+}
+
+void evlog_str(struct evlog_t *log, int type, uint32_t id,
+               uint64_t val, const char *str)
+{
+	struct evlog_rec_t rec;
+
+	memset(&rec, 0, sizeof(struct evlog_rec_t));
+	rec.type = type;
+	rec.id = id;
+	rec.u.s.val = val;
+	evlog_submit(log, &rec, str);
+}
+
+void evlog_printf(struct evlog_t *log, const char *fmt, ...)
+{
+	char buf[EVLOG_TEXT_MAX];
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	evlog_str(log, EV_TEXT, 0, 0, buf);
+}
+
+/*
+ * evlog_pop - take the next record in sequence order
+ * Return 0 if a record is taken, -1 if none is ready yet
+ */
+static int evlog_pop(struct evlog_t *log, uint64_t next, int flush, struct evlog_rec_t *out)
+{
+	struct evlog_ring_t *ring, *min = NULL;
+	uint64_t minseq = 0;
+
+	ring = atomic_load_explicit(&log->rings, memory_order_acquire);
+	for (; ring != NULL; ring = ring->next) {
+		uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+		if (tail == atomic_load_explicit(&ring->head, memory_order_acquire))
+			continue;
+		struct evlog_rec_t *rec = &ring->rec[tail & EVLOG_RING_MASK];
+		if (rec->seq == next || (flush && (min == NULL || rec->seq < minseq))) {
+			min = ring;
+			minseq = rec->seq;
+			if (rec->seq == next) break;
+		}
+	}
+
+	if (min == NULL) return -1;
+
+	uint64_t tail = atomic_load_explicit(&min->tail, memory_order_relaxed);
+	*out = min->rec[tail & EVLOG_RING_MASK];
+	atomic_store_explicit(&min->tail, tail + 1, memory_order_release);
+	return 0;
+}
+
+static void *evlog_routine(void *args)
+{
+	struct evlog_t *log = (struct evlog_t *)args;
+	struct evlog_dec_t dec;
+	struct evlog_rec_t rec;
+	uint64_t next = 0;
+
+	memset(&dec, 0, sizeof(struct evlog_dec_t));
+	while (1) {
+		int stopping = atomic_load(&log->stop);
+		if (evlog_pop(log, next, stopping, &rec) == 0) {
+			next = rec.seq + 1;
+			if (log->mode == EVLOG_BINARY)
+				fwrite(&rec, sizeof(struct evlog_rec_t), 1, log->out);
+			else
+				evlog_dec_rec(&dec, &rec, log->out);
+			continue;
+		}
+		if (stopping) break;
+		fflush(log->out);
+		evlog_pause();
+	}
+	fflush(log->out);
+	pthread_exit(NULL);
+}
+
+/*
+ * evlog_init - set up a log instance and start its logger thread
+ * @log  : log instance
+ * @mode : EVLOG_TEXT, EVLOG_BINARY or EVLOG_QUIET
+ * @path : output file of the binary mode
+ */
+int evlog_init(struct evlog_t *log, int mode, const char *path)
+{
+	memset(log, 0, sizeof(struct evlog_t));
+	log->id = atomic_fetch_add(&evlog_ids, 1);
+	log->mode = mode;
+	log->out = stdout;
+	atomic_init(&log->seq, 0);
+	atomic_init(&log->rings, NULL);
+	atomic_init(&log->stop, 0);
+	pthread_mutex_init(&log->rings_lock, NULL);
+
+	if (mode == EVLOG_BINARY) {
+		struct evlog_hdr_t hdr;
+
+		if ((log->out = fopen(path, "wb")) == NULL) {
+			printf("Cannot open event log at %s\n", path);
+			return -1;
+		}
+		memset(&hdr, 0, sizeof(hdr));
+		memcpy(hdr.magic, EVLOG_MAGIC, sizeof(hdr.magic));
+		hdr.recsz = sizeof(struct evlog_rec_t);
+		hdr.nrtypes = EV_MAX;
+		fwrite(&hdr, sizeof(hdr), 1, log->out);
+	}
+
+	if (mode != EVLOG_QUIET)
+		pthread_create(&log->thread, NULL, evlog_routine, (void*)log);
+
+	return 0;
+}
+
+/*
+ * evlog_stop - drain every ring, stop the logger thread and, in quiet
+ *              mode, print the summary statistics and the text messages
+ */
+void evlog_stop(struct evlog_t *log)
+{
+	struct evlog_ring_t *ring, *next;
+	unsigned long count[EV_MAX];
+	int i;
+
+	if (log->mode != EVLOG_QUIET) {
+		atomic_store(&log->stop, 1);
+		pthread_join(log->thread, NULL);
+	}
+
+	memset(count, 0, sizeof(count));
+	for (ring = atomic_load(&log->rings); ring != NULL; ring = next) {
+		next = ring->next;
+		for (i = 0; i < EV_MAX; i++)
+			count[i] += ring->count[i];
+		free(ring);
+	}
+
+	if (log->mode == EVLOG_QUIET) {
+		printf("Summary: %lu time slots, %lu processes loaded, %lu forked, %lu threads, %lu finished\n",
+			count[EV_TIME_SLOT], count[EV_LD_LOADED], count[EV_FORK],
+			count[EV_CLONE], count[EV_CPU_FINISH]);
+		printf("  dispatch %lu preempt %lu\n",
+			count[EV_CPU_DISPATCH], count[EV_CPU_PUT]);
+		printf("  alloc %lu free %lu read %lu write %lu\n",
+			count[EV_ALLOC], count[EV_FREE], count[EV_READ], count[EV_WRITE]);
+		if (log->text != NULL)
+			fputs(log->text, stdout);
+		free(log->text);
+		log->text = NULL;
+	}
+
+	if (log->mode == EVLOG_BINARY)
+		fclose(log->out);
+	pthread_mutex_destroy(&log->rings_lock);
+}
+
+/*
+ * evlog_decode - convert a binary log back to the text output
+ */
+int evlog_decode(FILE *in, FILE *out)
+{
+	struct evlog_hdr_t hdr;
+	struct evlog_dec_t dec;
+	struct evlog_rec_t rec;
+
+	if (fread(&hdr, sizeof(hdr), 1, in) != 1 ||
+	    memcmp(hdr.magic, EVLOG_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    hdr.recsz != sizeof(struct evlog_rec_t)) {
+		printf("Invalid event log\n");
+		return -1;
+	}
+
+	memset(&dec, 0, sizeof(struct evlog_dec_t));
+	while (fread(&rec, sizeof(struct evlog_rec_t), 1, in) == 1)
+		evlog_dec_rec(&dec, &rec, out);
+
+	return 0;
+}
@@ -19,14 +19,13 @@
 #include "mm64.h"
 #include "syscall.h"
 #include "libmem.h"
+#include "evlog.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
 
-static pthread_mutex_t mmvm_lock = PTHREAD_MUTEX_INITIALIZER;
-
 /* Helper to calculate PGN/OFFSET correctly based on mode */
-static void get_pgn_offset(addr_t addr, int *pgn, int *off) {
+static void get_pgn_offset(addr_t addr, addr_t *pgn, int *off) {
 #ifdef MM64
     *pgn = addr >> PAGING64_ADDR_PT_SHIFT;
     *off = addr & PAGING64_ADDR_OFFST_MASK;
@@ -37,7 +36,7 @@ static void get_pgn_offset(addr_t addr, int *pgn, int *off) {
 }
 
 /* Helper to calculate PHYADDR correctly */
-static int get_phyaddr(int fpn, int off) {
+static addr_t get_phyaddr(addr_t fpn, int off) {
 #ifdef MM64
     return (fpn << PAGING64_ADDR_PT_SHIFT) + off;
 #else
@@ -45,6 +44,25 @@ static int get_phyaddr(int fpn, int off) {
 #endif
 }
 
+/* Helpers to guard the mm of the caller. The 64-bit one has a lock
+ * of its own, the 32-bit one shares the frames with no reclaim lock
+ * and takes the mmvm_lock */
+static void mm_lock(struct pcb_t *caller) {
+#ifdef MM64
+    pthread_mutex_lock(&caller->mm->lock);
+#else
+    pthread_mutex_lock(&caller->krnl->mmvm_lock);
+#endif
+}
+
+static void mm_unlock(struct pcb_t *caller) {
+#ifdef MM64
+    pthread_mutex_unlock(&caller->mm->lock);
+#else
+    pthread_mutex_unlock(&caller->krnl->mmvm_lock);
+#endif
+}
+
 /*enlist_vm_freerg_list - add new rg to freerg_list
  *@mm: memory region
  *@rg_elmt: new region
@@ -80,7 +98,7 @@ struct vm_rg_struct *get_symrg_byid(struct mm_struct *mm, int rgid)
  */
 int __alloc(struct pcb_t *caller, int vmaid, int rgid, addr_t size, addr_t *alloc_addr)
 {
-  pthread_mutex_lock(&mmvm_lock);
+  mm_lock(caller);
   struct vm_rg_struct rgnode;
   struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
   int inc_sz=0;
@@ -90,7 +108,7 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, addr_t size, addr_t *allo
     caller->mm->symrgtbl[rgid].rg_start = rgnode.rg_start;
     caller->mm->symrgtbl[rgid].rg_end = rgnode.rg_end;
     *alloc_addr = rgnode.rg_start;
-    pthread_mutex_unlock(&mmvm_lock);
+    mm_unlock(caller);
     return 0;
   }
 
@@ -113,7 +131,7 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, addr_t size, addr_t *allo
 #endif 
 
   if (syscall(caller->krnl, caller->pid, 17, &regs) == -1) {
-      pthread_mutex_unlock(&mmvm_lock);
+      mm_unlock(caller);
       return -1; 
   }
 
@@ -121,7 +139,7 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, addr_t size, addr_t *allo
   caller->mm->symrgtbl[rgid].rg_end = old_sbrk + size;
   *alloc_addr = old_sbrk;
 
-  pthread_mutex_unlock(&mmvm_lock);
+  mm_unlock(caller);
   return 0;
 }
 
@@ -134,14 +152,14 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, addr_t size, addr_t *allo
  */
 int __free(struct pcb_t *caller, int vmaid, int rgid)
 {
-  pthread_mutex_lock(&mmvm_lock);
+  mm_lock(caller);
   if (rgid < 0 || rgid > PAGING_MAX_SYMTBL_SZ) {
-    pthread_mutex_unlock(&mmvm_lock);
+    mm_unlock(caller);
     return -1;
   }
   struct vm_rg_struct *rgnode = get_symrg_byid(caller->mm, rgid);
   if (rgnode->rg_start == 0 && rgnode->rg_end == 0) {
-    pthread_mutex_unlock(&mmvm_lock);
+    mm_unlock(caller);
     return -1;
   }
   struct vm_rg_struct *freerg_node = malloc(sizeof(struct vm_rg_struct));
@@ -151,7 +169,7 @@ int __free(struct pcb_t *caller, int vmaid, int rgid)
   rgnode->rg_start = rgnode->rg_end = 0;
   rgnode->rg_next = NULL;
   enlist_vm_freerg_list(caller->mm, freerg_node);
-  pthread_mutex_unlock(&mmvm_lock);
+  mm_unlock(caller);
   return 0;
 }
 
@@ -162,8 +180,7 @@ int __free(struct pcb_t *caller, int vmaid, int rgid)
  */
 int liballoc(struct pcb_t *proc, addr_t size, uint32_t reg_index)
 {
-  printf("%s:%d\n", __func__, __LINE__);
-  fflush(stdout);
+  evlog_event(proc->krnl->log, EV_ALLOC, proc->pid, __LINE__, 0, 0, 0);
   addr_t addr;
   int val = __alloc(proc, 0, reg_index, size, &addr);
   if (val == -1) {
@@ -187,8 +204,7 @@ int liballoc(struct pcb_t *proc, addr_t size, uint32_t reg_index)
  */
 int libfree(struct pcb_t *proc, uint32_t reg_index)
 {
-  printf("%s:%d\n", __func__, __LINE__);
-  fflush(stdout);
+  evlog_event(proc->krnl->log, EV_FREE, proc->pid, __LINE__, 0, 0, 0);
   int val = __free(proc, 0, reg_index);
   if (val == -1) {
     // printf("[ERROR] libfree failed for process %d\n", proc->pid);
@@ -203,70 +219,616 @@ int libfree(struct pcb_t *proc, uint32_t reg_index)
   return val;
 }
 
-/*pg_getpage - get the page in ram
+#ifdef MM64
+/*select_victim_mm - pick the address space a frame is reclaimed from
+ *@krnl: kernel
+ *
+ * Every process holding resident pages competes, the one with the
+ * least recent activity per resident page gives a frame up, so RAM
+ * follows the active working sets rather than the faulting process.
+ * The mmvm_lock is held, so the lock of the victim is only tried: an
+ * mm busy in another thread is passed over. The victim is returned
+ * locked
+ */
+static struct mm_struct *select_victim_mm(struct krnl_t *krnl)
+{
+  struct mm_struct *mm, *vicmm = NULL;
+  uint64_t score, best = 0, nr, vicnr = 0;
+  int i;
+
+  for (mm = krnl->mm_list; mm != NULL; mm = mm->mm_next)
+  {
+    for (nr = 0, i = 0; i < MM_NR_PGLIST; i++)
+      nr += mm->pglist[i].nr;
+    if (nr == 0) continue;
+
+    score = (mm->activity << 8) / nr;
+    if (vicmm != NULL && score > best) continue;
+    if (vicmm != NULL && score == best && nr <= vicnr) continue;
+    if (pthread_mutex_trylock(&mm->lock) != 0) continue;
+
+    if (vicmm != NULL)
+      pthread_mutex_unlock(&vicmm->lock);
+    vicmm = mm;
+    best = score;
+    vicnr = nr;
+  }
+
+  return vicmm;
+}
+
+/*swap_get_slot - pick a swap device and a slot on it
+ *@krnl: kernel
+ *@mm: address space of the page about to be evicted
+ *@pgn: its PGN
+ *@swptyp: return swap device
+ *@swpfpn: return slot
+ *
+ * A page whose previous virtual page is in swap goes right after it,
+ * on the same device, so a run of pages fills a cluster of slots. A
+ * new cluster goes to the device of highest priority with free slots.
+ * Devices of equal priority take turns, so even one long run is
+ * striped over all of them
+ */
+int swap_get_slot(struct krnl_t *krnl, struct mm_struct *mm, addr_t pgn,
+                  int *swptyp, addr_t *swpfpn)
+{
+  uint64_t pte = (pgn > 0) ? pgtbl_load(mm, pgn - 1) : 0;
+  int i, id = -1;
+  addr_t hint = FRAME_NIL;
+
+  if (pte & PAGING_PTE_SWAPPED_MASK)
+  {
+    id = PAGING_SWPTYP(pte);
+    hint = PAGING_SWP(pte) + 1;
+  }
+  else if (PAGING_PAGE_PRESENT(pte) && (pte & PAGING_PTE_SWPCOPY_MASK))
+  {
+    id = PAGING_SWPCOPY_TYP(pte);
+    hint = PAGING_SWPCOPY(pte) + 1;
+  }
+
+  if (id < 0 || id >= PAGING_MAX_MMSWP || hint % MM_SWAP_CLUSTER == 0 ||
+      !MEMPHY_is_freefp(&krnl->mswp[id], hint))
+  {
+    hint = FRAME_NIL;
+    id = -1;
+    for (i = 1; i <= PAGING_MAX_MMSWP; i++)
+    {
+      int cand = (krnl->active_mswp_id + i) % PAGING_MAX_MMSWP;
+      if (krnl->mswp[cand].free_fp_top == 0)
+        continue;
+      if (id < 0 || krnl->mswp_prio[cand] > krnl->mswp_prio[id])
+        id = cand;
+    }
+    if (id < 0)
+      return -1;
+    krnl->active_mswp_id = id;
+    krnl->active_mswp = &krnl->mswp[id];
+  }
+
+  *swptyp = id;
+  return MEMPHY_get_freefp_near(&krnl->mswp[id], hint, MM_SWAP_CLUSTER, swpfpn);
+}
+
+/*swap_out_page - send one resident page to swap
+ *@krnl: kernel
+ *@caller: faulting process, NULL for kswapd
+ *@mm: address space of the page
+ *@pgn: the page
+ *@fpn: its frame, left to the caller
+ *@take: fpn may go to the compressed cache as a pool frame
+ *
+ * A clean page whose swap copy is still valid is not written back,
+ * its PTE just points at the copy again. Otherwise the compressed
+ * cache is tried before a swap device. kswapd has no process to
+ * issue the swap syscall for, it copies the frame itself. Return 1
+ * when the cache took fpn, it is not free then
+ */
+static int swap_out_page(struct krnl_t *krnl, struct pcb_t *caller,
+                         struct mm_struct *mm, addr_t pgn, addr_t fpn,
+                         int take)
+{
+  uint64_t pte = pgtbl_load(mm, pgn);
+  addr_t swpfpn;
+  struct sc_regs regs;
+  int swptyp, ret = 0;
+
+  if ((pte & PAGING_PTE_SWPCOPY_MASK) && !(pte & PAGING_PTE_DIRTY_MASK))
+  {
+    swptyp = PAGING_SWPCOPY_TYP(pte);
+    swpfpn = PAGING_SWPCOPY(pte);
+    krnl->nr_swpout_clean++;
+  }
+  else if (krnl->zswap != NULL &&
+           (ret = zswap_store(krnl, mm, pgn, fpn, take, &swpfpn)) >= 0)
+  {
+    swptyp = ZSWAP_SWPTYP;
+  }
+  else
+  {
+    ret = 0;
+    if (swap_get_slot(krnl, mm, pgn, &swptyp, &swpfpn) == -1)
+      return -1;
+    if (caller != NULL)
+    {
+      regs.a1 = SYSMEM_SWP_OP;
+      regs.a2 = fpn;
+      regs.a3 = swpfpn;
+      regs.a4 = swptyp;
+      syscall(krnl, caller->pid, 17, &regs);
+    }
+    else
+      __swap_cp_page(krnl->mram, fpn, &krnl->mswp[swptyp], swpfpn);
+    krnl->nr_swpout++;
+    krnl->nr_swpout_dev[swptyp]++;
+  }
+
+  pgtbl_set_swap(krnl, mm, pgn, swptyp, swpfpn);
+  return ret;
+}
+
+/*swap_out_shared - send every page of a shared frame to swap
+ *@krnl: kernel
+ *@caller: faulting process, NULL for kswapd
+ *@fpn: the frame, off the page lists
+ *
+ * Each page gets a swap copy of its own, found through the reverse
+ * map, under the lock of its mm. When swap runs out the pages still
+ * in RAM keep the frame. So they do when the mm of one is busy in
+ * another thread, 1 is returned then
+ */
+static int swap_out_shared(struct krnl_t *krnl, struct pcb_t *caller, addr_t fpn)
+{
+  struct framedesc_t *fd = &krnl->mram->fdesc[fpn];
+  struct mm_struct *mm;
+  struct rmap_t *r;
+  addr_t pgn;
+  int ret = 0;
+
+  while ((r = fd->rmap) != NULL)
+  {
+    mm = r->mm;
+    pgn = r->pgn;
+    if (pthread_mutex_trylock(&mm->lock) != 0)
+      ret = 1;
+    else
+    {
+      if (swap_out_page(krnl, caller, mm, pgn, fpn, 0) != 0)
+        ret = -1;
+      else
+        rmap_del(krnl->mram, fpn, mm, pgn);
+      pthread_mutex_unlock(&mm->lock);
+    }
+
+    if (ret != 0)
+    {
+      frame_settle(krnl, fpn);
+      return ret;
+    }
+  }
+  ksm_forget(krnl, fpn);
+  return 0;
+}
+
+/*reclaim_frame - send a victim page to swap and take its frame
+ *@krnl: kernel
+ *@caller: faulting process, NULL for kswapd
+ *@fpn: return FPN
+ *
+ * The victim may belong to any process, see select_victim_mm. A
+ * shared frame is only taken once all of its pages are out. A victim
+ * frame the compressed cache grew its pool with is not free, nor is
+ * a shared one with a sharer busy in another thread: the next victim
+ * is taken then, at most once per frame of RAM
+ */
+static int reclaim_frame(struct krnl_t *krnl, struct pcb_t *caller, addr_t *fpn)
+{
+  struct mm_struct *vicmm;
+  addr_t vicpgn, vicfpn = FRAME_NIL, tries = 0;
+  int ret;
+
+  do
+  {
+    if ((vicmm = select_victim_mm(krnl)) == NULL) return -1;
+
+    if (find_victim_page(krnl, vicmm, &vicpgn) == -1)
+      ret = -1;
+    else
+    {
+      vicfpn = PAGING_FPN(pgtbl_load(vicmm, vicpgn));
+      if (krnl->mram->fdesc[vicfpn].nref > 0)
+        ret = swap_out_shared(krnl, caller, vicfpn);
+      else if ((ret = swap_out_page(krnl, caller, vicmm, vicpgn, vicfpn, 1)) < 0)
+        enlist_pgn_node(vicmm, vicpgn, vicfpn);
+    }
+
+    if (ret >= 0 && caller != NULL && vicmm != caller->mm)
+      krnl->nr_steal++;
+    pthread_mutex_unlock(&vicmm->lock);
+    if (ret < 0) return -1;
+  } while (ret == 1 && ++tries < krnl->mram->numfp);
+
+  if (ret == 1) return -1;
+
+  /* Old bursts of activity fade */
+  if (++krnl->nr_reclaim % MM_ACTIVITY_DECAY == 0)
+    for (vicmm = krnl->mm_list; vicmm != NULL; vicmm = vicmm->mm_next)
+      vicmm->activity >>= 1;
+  *fpn = vicfpn;
+  return 0;
+}
+
+/*pg_getframe - get a free RAM frame, a victim page goes to swap
+ *               when none is left
+ *@caller: caller
+ *@fpn: return FPN
+ *
+ * kswapd keeps frames free ahead of time, the victim is only taken
+ * here when it falls behind
+ */
+int pg_getframe(struct pcb_t *caller, addr_t *fpn)
+{
+  if (MEMPHY_get_freefp(caller->krnl->mram, fpn) == 0)
+    return 0;
+
+  return reclaim_frame(caller->krnl, caller, fpn);
+}
+
+/*kswapd_balance - refill the free RAM frames in the background
+ *@krnl: kernel
+ *
+ * Nothing happens above the low watermark. Below it, victims go to
+ * swap until the high watermark is reached. On a small RAM the
+ * percentages round down to nothing, the watermarks are then kept at
+ * one and two frames
+ */
+int kswapd_balance(struct krnl_t *krnl)
+{
+  struct memphy_struct *mram = krnl->mram;
+  addr_t low = mram->numfp * MM_WMARK_LOW / 100;
+  addr_t high = mram->numfp * MM_WMARK_HIGH / 100;
+  addr_t fpn;
+
+  if (low < 1)
+    low = 1;
+  if (high <= low)
+    high = low + 1;
+  int nr = 0;
+
+  pthread_mutex_lock(&krnl->mmvm_lock);
+  if (mram->free_fp_top < low)
+  {
+    while (mram->free_fp_top < high && reclaim_frame(krnl, NULL, &fpn) == 0)
+    {
+      MEMPHY_put_freefp(mram, fpn);
+      nr++;
+    }
+    krnl->nr_kswapd += nr;
+  }
+  pthread_mutex_unlock(&krnl->mmvm_lock);
+  return nr;
+}
+
+/*pg_fault - back a page touched for the first time
  *@mm: memory region
- *@pagenum: PGN
- *@framenum: return FPN
+ *@pgn: PGN
+ *@write: the access is a write
  *@caller: caller
  *
+ * A read maps the shared zero frame, a write gets a cleared frame of
+ * its own, or a whole huge page when its 2 MiB block is still empty
  */
-int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
+static int pg_fault(struct mm_struct *mm, addr_t pgn, int write, struct pcb_t *caller)
 {
-  uint32_t pte = pte_get_entry(caller, pgn);
+  struct memphy_struct *mram = caller->krnl->mram;
+  struct vm_area_struct *vma;
+  addr_t base = pgn & ~(addr_t)(PAGING64_HUGE_PGNUM - 1);
+  addr_t tgtfpn;
+
+  vma = get_vma_by_addr(mm, pgn << PAGING64_ADDR_PT_SHIFT);
+  if (vma == NULL)
+    return -1;
+
+  if (!write && PAGING_HAS_ZERO_FRAME(mram))
+    return pgtbl_store(mm, pgn, PAGING_PTE_PRESENT_MASK | PAGING_PTE_ZERO_MASK |
+                                PAGING_ZERO_FPN);
+
+  if ((base << PAGING64_ADDR_PT_SHIFT) >= vma->vm_start &&
+      ((base + PAGING64_HUGE_PGNUM) << PAGING64_ADDR_PT_SHIFT) <= vma->sbrk &&
+      vmap_huge_page(caller, base) == 0)
+    return 0;
+
+  if (pg_getframe(caller, &tgtfpn) != 0)
+    return -1;
+  MEMPHY_clear_frames(mram, tgtfpn, 1, PAGING64_PAGESZ);
+  pte_set_fpn(caller, pgn, tgtfpn);
+  enlist_pgn_node(mm, pgn, tgtfpn);
+  return 0;
+}
 
-  if (!PAGING_PAGE_PRESENT(pte))
-  { 
-    addr_t tgtfpn;
-    if (MEMPHY_get_freefp(caller->krnl->mram, &tgtfpn) == 0)
+/*pg_swapin - bring a swapped page back into a RAM frame
+ *@mm: memory region
+ *@pgn: PGN
+ *@pte: its swapped PTE
+ *@tgtfpn: RAM frame to fill
+ *@caller: caller
+ *
+ * The swap slot is kept as a copy until the page is written, a page
+ * of the compressed cache leaves it
+ */
+static void pg_swapin(struct mm_struct *mm, addr_t pgn, uint64_t pte,
+                      addr_t tgtfpn, struct pcb_t *caller)
+{
+  addr_t swpfpn = PAGING_SWP(pte);
+  uint64_t swptyp = PAGING_SWPTYP(pte);
+  struct sc_regs regs;
+
+  /* Nothing is kept in the compressed cache once the page is back */
+  if (swptyp == ZSWAP_SWPTYP)
+  {
+    zswap_load(caller->krnl, swpfpn, tgtfpn);
+    pte_set_fpn(caller, pgn, tgtfpn);
+    enlist_pgn_node(mm, pgn, tgtfpn);
+    return;
+  }
+
+  regs.a1 = SYSMEM_SWPIN_OP;
+  regs.a2 = swpfpn;
+  regs.a3 = tgtfpn;
+  regs.a4 = swptyp;
+  syscall(caller->krnl, caller->pid, 17, &regs);
+
+  pte_set_fpn(caller, pgn, tgtfpn);
+  pgtbl_update(mm, pgn, PAGING_PTE_SWPCOPY_MASK |
+               ((uint64_t)swpfpn << PAGING_PTE_SWPCOPY_LOBIT) |
+               (swptyp << PAGING_PTE_SWPCOPY_TYP_LOBIT), 0);
+  enlist_pgn_node(mm, pgn, tgtfpn);
+}
+
+/*pg_readahead - swap in the pages following a swap fault
+ *@mm: memory region
+ *@pgn: PGN of the faulting page
+ *@caller: caller
+ *
+ * Up to MM_SWAP_READAHEAD following pages still in swap come back
+ * with it. Free frames are used first, then at most
+ * MM_SWAP_READAHEAD_RECLAIM victims are evicted for them. An
+ * eviction that took the faulting page itself gives its frame back
+ * to that page and ends the readahead. The pages read are left not
+ * accessed, the first to go if unused. Pages of the compressed cache
+ * are cheap to fault and are left there
+ */
+static void pg_readahead(struct mm_struct *mm, addr_t pgn, struct pcb_t *caller)
+{
+  struct krnl_t *krnl = caller->krnl;
+  int budget = MM_SWAP_READAHEAD_RECLAIM;
+  addr_t i, tgtfpn;
+  uint64_t pte;
+
+  for (i = 1; i <= MM_SWAP_READAHEAD; i++)
+  {
+    pte = pgtbl_load(mm, pgn + i);
+    if (!(pte & PAGING_PTE_SWAPPED_MASK) || PAGING_SWPTYP(pte) == ZSWAP_SWPTYP)
+      break;
+    if (MEMPHY_get_freefp(krnl->mram, &tgtfpn) != 0)
     {
-      if (pte != 0 && (pte & PAGING_PTE_SWAPPED_MASK))
+      if (budget-- == 0 || reclaim_frame(krnl, caller, &tgtfpn) != 0)
+        break;
+      pte = pgtbl_load(mm, pgn);
+      if (!PAGING_PAGE_PRESENT(pte))
       {
-        addr_t old_swpfpn = PAGING_SWP(pte);
-        struct sc_regs regs;
-        regs.a1 = SYSMEM_SWP_OP;
-        regs.a2 = old_swpfpn;
-        regs.a3 = tgtfpn;
-        syscall(caller->krnl, caller->pid, 17, &regs);
-        MEMPHY_put_freefp(caller->krnl->active_mswp, old_swpfpn);
+        pg_swapin(mm, pgn, pte, tgtfpn, caller);
+        break;
       }
-      pte_set_fpn(caller, pgn, tgtfpn);
-      enlist_pgn_node(&caller->mm->fifo_pgn, pgn);
     }
-    else
-    {
-      addr_t vicpgn, swpfpn, vicfpn;
-      if (find_victim_page(caller->mm, &vicpgn) == -1) return -1;
-      if (MEMPHY_get_freefp(caller->krnl->active_mswp, &swpfpn) == -1) return -1;
+    pg_swapin(mm, pgn + i, pte, tgtfpn, caller);
+    krnl->nr_readahead++;
+  }
+}
+
+/*pg_cow - give a page of a shared frame a copy of its own
+ *@mm: memory region
+ *@pgn: PGN written to
+ *@caller: caller
+ *
+ * Return 1 when reclaim took the shared frame while a frame was
+ * found for the copy, the access is then retried from the start
+ */
+static int pg_cow(struct mm_struct *mm, addr_t pgn, struct pcb_t *caller)
+{
+  struct memphy_struct *mram = caller->krnl->mram;
+  addr_t fpn, tgtfpn;
+  uint64_t pte;
 
-      uint32_t vicpte = pte_get_entry(caller, vicpgn);
-      vicfpn = PAGING_FPN(vicpte);
+  if (pg_getframe(caller, &tgtfpn) != 0) return -1;
 
-      struct sc_regs regs;
-      regs.a1 = SYSMEM_SWP_OP;
-      regs.a2 = vicfpn;
-      regs.a3 = swpfpn;
-      syscall(caller->krnl, caller->pid, 17, &regs);
+  pte = pgtbl_load(mm, pgn);
+  if (!PAGING_PAGE_PRESENT(pte) || !(pte & PAGING_PTE_COW_MASK))
+  {
+    MEMPHY_put_freefp(mram, tgtfpn);
+    return 1;
+  }
+
+  fpn = PAGING_FPN(pte);
+  __swap_cp_page(mram, fpn, mram, tgtfpn);
+  frame_unmap(caller->krnl, fpn, mm, pgn);
+  pte_set_fpn(caller, pgn, tgtfpn);
+  enlist_pgn_node(mm, pgn, tgtfpn);
+  caller->krnl->nr_cow++;
+  return 0;
+}
 
-      pte_set_swap(caller, vicpgn, 0, swpfpn);
-      tgtfpn = vicfpn;
+/*pg_resolve - make a page ready for an access its PTE refuses
+ *@mm: memory region
+ *@pgn: PGN
+ *@write: the access is a write
+ *@caller: caller
+ *
+ * Frames are only given on the first touch of a page. A write to a
+ * shared frame copies it first, and one to a page with a swap copy
+ * lets the copy go. Runs under the mmvm_lock: frames, swap slots and
+ * other address spaces are involved
+ */
+static int pg_resolve(struct mm_struct *mm, addr_t pgn, int write, struct pcb_t *caller)
+{
+  struct krnl_t *krnl = caller->krnl;
+  addr_t tgtfpn;
+  uint64_t pte;
+  int ret;
+
+  do
+  {
+    pte = pgtbl_load(mm, pgn);
+    if (pte == 0 || (write && (pte & PAGING_PTE_ZERO_MASK)))
+    {
+      if (pg_fault(mm, pgn, write, caller) != 0) return -1;
+      krnl->nr_pgfault++;
+      pte = pgtbl_load(mm, pgn);
+    }
+    else if (!PAGING_PAGE_PRESENT(pte))
+    {
+      if (pg_getframe(caller, &tgtfpn) != 0) return -1;
+
+      /* Making room may have written the page back out of zswap */
+      pte = pgtbl_load(mm, pgn);
+      pg_swapin(mm, pgn, pte, tgtfpn, caller);
+      pg_readahead(mm, pgn, caller);
+      krnl->nr_pgfault++;
+      krnl->nr_pgfault_swp++;
+      pte = pgtbl_load(mm, pgn);
+    }
 
-      if (pte != 0 && (pte & PAGING_PTE_SWAPPED_MASK))
+    /* Reclaim may take the shared frame while the copy gets one */
+    ret = 0;
+    if (write && (pte & PAGING_PTE_COW_MASK))
+    {
+      if ((ret = pg_cow(mm, pgn, caller)) < 0) return -1;
+      if (ret == 0)
       {
-        addr_t old_swpfpn = PAGING_SWP(pte);
-        regs.a1 = SYSMEM_SWP_OP;
-        regs.a2 = old_swpfpn;
-        regs.a3 = tgtfpn;
-        syscall(caller->krnl, caller->pid, 17, &regs);
-        MEMPHY_put_freefp(caller->krnl->active_mswp, old_swpfpn);
+        krnl->nr_pgfault++;
+        pte = pgtbl_load(mm, pgn);
       }
-      pte_set_fpn(caller, pgn, tgtfpn);
-      enlist_pgn_node(&caller->mm->fifo_pgn, pgn);
     }
+  } while (ret == 1);
+
+  if (write && (pte & PAGING_PTE_SWPCOPY_MASK))
+  {
+    MEMPHY_put_freefp(&krnl->mswp[PAGING_SWPCOPY_TYP(pte)], PAGING_SWPCOPY(pte));
+    pgtbl_update(mm, pgn, 0, PAGING_PTE_SWPCOPY_MASK |
+                 PAGING_PTE_SWPCOPY_OFF_MASK | PAGING_PTE_SWPCOPY_TYP_MASK);
   }
-  *fpn = PAGING_FPN(pte_get_entry(caller, pgn));
   return 0;
 }
 
+/*pg_getpage - get the page in ram
+ *@mm: memory region
+ *@pagenum: PGN
+ *@framenum: return FPN
+ *@write: the access is a write
+ *@caller: caller
+ *
+ * A TLB hit skips the walk, a walk to an online page refills it.
+ * The walk marks the PTE accessed, and dirty on a write. Every
+ * access counts toward the activity global reclaim weighs mm by.
+ * All of it only needs the lock of mm, held by the caller: nothing
+ * else changes a PTE without it. An access the PTE refuses goes to
+ * pg_resolve under the mmvm_lock
+ */
+int pg_getpage(struct mm_struct *mm, addr_t pgn, addr_t *fpn, int write, struct pcb_t *caller)
+{
+  uint64_t setmask = PAGING_PTE_ACCESSED_MASK | (write ? PAGING_PTE_DIRTY_MASK : 0);
+  uint64_t pte;
+
+  mm->activity++;
+  if (tlb_lookup(caller->tlb, mm->asid, pgn, write, fpn) == 0)
+    return 0;
+
+  pte = pgtbl_load(mm, pgn);
+  if (!PAGING_PAGE_PRESENT(pte) ||
+      (write && (pte & (PAGING_PTE_ZERO_MASK | PAGING_PTE_COW_MASK |
+                        PAGING_PTE_SWPCOPY_MASK))))
+  {
+    pthread_mutex_lock(&caller->krnl->mmvm_lock);
+    if (pg_resolve(mm, pgn, write, caller) != 0)
+    {
+      pthread_mutex_unlock(&caller->krnl->mmvm_lock);
+      return -1;
+    }
+    pthread_mutex_unlock(&caller->krnl->mmvm_lock);
+    pte = pgtbl_load(mm, pgn);
+  }
+
+  if ((pte & setmask) != setmask)
+  {
+    pgtbl_update(mm, pgn, setmask, 0);
+    pte |= setmask;
+  }
+  *fpn = PAGING_FPN(pte);
+
+  /* The zero frame is left out, a write must fault to replace it */
+  if (!(pte & PAGING_PTE_ZERO_MASK))
+    tlb_fill(caller->tlb, mm->asid, pgn, *fpn,
+             (pte & PAGING64_PTE_HUGE_MASK) != 0,
+             (pte & PAGING_PTE_DIRTY_MASK) != 0);
+  return 0;
+}
+#else
+/*pg_getpage - get the page in ram
+ *@mm: memory region
+ *@pagenum: PGN
+ *@framenum: return FPN
+ *@write: the access is a write, the 32-bit PTE keeps no dirty bit
+ *@caller: caller
+ *
+ * The 32-bit paging has neither reclaim nor policies: the victim is
+ * the oldest page of the FIFO of the caller, it goes to the active
+ * swap device
+ */
+int pg_getpage(struct mm_struct *mm, addr_t pgn, addr_t *fpn, int write, struct pcb_t *caller)
+{
+  struct krnl_t *krnl = caller->krnl;
+  uint32_t pte = pte_get_entry(caller, pgn);
+  addr_t tgtfpn, vicpgn, swpfpn;
+  struct sc_regs regs;
+
+  if (PAGING_PAGE_PRESENT(pte) && !(pte & PAGING_PTE_SWAPPED_MASK))
+  {
+    *fpn = PAGING_FPN(pte);
+    return 0;
+  }
+
+  if (MEMPHY_get_freefp(krnl->mram, &tgtfpn) != 0)
+  {
+    if (find_victim_page(krnl, mm, &vicpgn) == -1) return -1;
+    if (MEMPHY_get_freefp(krnl->active_mswp, &swpfpn) == -1) return -1;
+
+    tgtfpn = PAGING_FPN(pte_get_entry(caller, vicpgn));
+    regs.a1 = SYSMEM_SWP_OP;
+    regs.a2 = tgtfpn;
+    regs.a3 = swpfpn;
+    regs.a4 = krnl->active_mswp_id;
+    syscall(krnl, caller->pid, 17, &regs);
+    pte_set_swap(caller, vicpgn, krnl->active_mswp_id, swpfpn);
+  }
+
+  if (pte & PAGING_PTE_SWAPPED_MASK)
+  {
+    regs.a1 = SYSMEM_SWPIN_OP;
+    regs.a2 = PAGING_SWP(pte);
+    regs.a3 = tgtfpn;
+    regs.a4 = PAGING_SWPTYP(pte);
+    syscall(krnl, caller->pid, 17, &regs);
+    MEMPHY_put_freefp(&krnl->mswp[PAGING_SWPTYP(pte)], PAGING_SWP(pte));
+  }
+  pte_set_fpn(caller, pgn, tgtfpn);
+  enlist_pgn_node(&mm->fifo_pgn, pgn);
+
+  *fpn = tgtfpn;
+  return 0;
+}
+#endif
+
 /*pg_getval - read value at given offset
  *@mm: memory region
  *@addr: virtual address to acess
@@ -275,12 +837,13 @@ int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
  */
 int pg_getval(struct mm_struct *mm, addr_t addr, BYTE *data, struct pcb_t *caller)
 {
-  int pgn, off, fpn;
+  addr_t pgn, fpn;
+  int off;
   get_pgn_offset(addr, &pgn, &off); 
 
-  if (pg_getpage(mm, pgn, &fpn, caller) != 0) return -1;
+  if (pg_getpage(mm, pgn, &fpn, 0, caller) != 0) return -1;
 
-  int phyaddr = get_phyaddr(fpn, off); 
+  addr_t phyaddr = get_phyaddr(fpn, off); 
 
   struct sc_regs regs;
   regs.a1 = SYSMEM_IO_READ;
@@ -302,12 +865,13 @@ int pg_getval(struct mm_struct *mm, addr_t addr, BYTE *data, struct pcb_t *calle
  */
 int pg_setval(struct mm_struct *mm, addr_t addr, BYTE value, struct pcb_t *caller)
 {
-  int pgn, off, fpn;
+  addr_t pgn, fpn;
+  int off;
   get_pgn_offset(addr, &pgn, &off); 
 
-  if (pg_getpage(mm, pgn, &fpn, caller) != 0) return -1;
+  if (pg_getpage(mm, pgn, &fpn, 1, caller) != 0) return -1;
 
-  int phyaddr = get_phyaddr(fpn, off); 
+  addr_t phyaddr = get_phyaddr(fpn, off); 
 
   struct sc_regs regs;
   regs.a1 = SYSMEM_IO_WRITE;
@@ -330,22 +894,22 @@ int pg_setval(struct mm_struct *mm, addr_t addr, BYTE value, struct pcb_t *calle
  */
 int __read(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE *data)
 {
-  pthread_mutex_lock(&mmvm_lock);
+  mm_lock(caller);
   struct vm_rg_struct *currg = get_symrg_byid(caller->mm, rgid);
   struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
 
   if (currg == NULL || cur_vma == NULL) {
-    pthread_mutex_unlock(&mmvm_lock);
+    mm_unlock(caller);
     return -1;
   }
   if (currg->rg_start + offset >= currg->rg_end) {
-    pthread_mutex_unlock(&mmvm_lock);
+    mm_unlock(caller);
     return -1; 
   }
 
-  pg_getval(caller->mm, currg->rg_start + offset, data, caller);
-  pthread_mutex_unlock(&mmvm_lock);
-  return 0;
+  int ret = pg_getval(caller->mm, currg->rg_start + offset, data, caller);
+  mm_unlock(caller);
+  return ret;
 }
 
 /*libread - PAGING-based read a region memory */
@@ -355,8 +919,7 @@ int libread(
     addr_t offset,    // Source address = [source] + [offset]
     uint32_t* destination)
 {
-  printf("%s:%d\n", __func__, __LINE__);
-  fflush(stdout);
+  evlog_event(proc->krnl->log, EV_READ, proc->pid, __LINE__, 0, 0, 0);
   BYTE data;
   int val = __read(proc, 0, source, offset, &data);
   if (val == -1) {
@@ -365,7 +928,7 @@ int libread(
   }
   *destination = (uint32_t)data;
 #ifdef IODUMP
-  /* TODO dump IO content (if needed) */
+  evlog_event(proc->krnl->log, EV_READ_VAL, proc->pid, source, offset, data, 0);
 #ifdef PAGETBL_DUMP
   print_pgtbl(proc, 0, -1); // print max TBL
 #endif
@@ -383,22 +946,22 @@ int libread(
  */
 int __write(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE value)
 {
-  pthread_mutex_lock(&mmvm_lock);
+  mm_lock(caller);
   struct vm_rg_struct *currg = get_symrg_byid(caller->mm, rgid);
   struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
 
   if (currg == NULL || cur_vma == NULL) {
-    pthread_mutex_unlock(&mmvm_lock);
+    mm_unlock(caller);
     return -1;
   }
   if (currg->rg_start + offset >= currg->rg_end) {
-    pthread_mutex_unlock(&mmvm_lock);
+    mm_unlock(caller);
     return -1;
   }
 
-  pg_setval(caller->mm, currg->rg_start + offset, value, caller);
-  pthread_mutex_unlock(&mmvm_lock);
-  return 0;
+  int ret = pg_setval(caller->mm, currg->rg_start + offset, value, caller);
+  mm_unlock(caller);
+  return ret;
 }
 
 /*libwrite - PAGING-based write a region memory */
@@ -408,8 +971,7 @@ int libwrite(
     uint32_t destination, // Index of destination register
     addr_t offset)
 {
-  printf("%s:%d\n", __func__, __LINE__);
-  fflush(stdout);
+  evlog_event(proc->krnl->log, EV_WRITE, proc->pid, __LINE__, 0, 0, 0);
   int val = __write(proc, 0, destination, offset, data);
   
 #ifdef IODUMP
@@ -432,13 +994,65 @@ int libwrite(
  *@vmaid: ID vm area to alloc memory region
  *@incpgnum: number of page
  */
+#ifdef MM64
+static int free_pte_frame(addr_t pgn, uint64_t pte, void *arg)
+{
+  struct pcb_t *caller = (struct pcb_t *)arg;
+
+  if ((pte & PAGING_PTE_SWAPPED_MASK) && PAGING_SWPTYP(pte) == ZSWAP_SWPTYP)
+    zswap_invalidate(caller->krnl, PAGING_SWP(pte));
+  else if (pte & PAGING_PTE_SWAPPED_MASK)
+    MEMPHY_put_freefp(&caller->krnl->mswp[PAGING_SWPTYP(pte)], PAGING_SWP(pte));
+  else if (pte & (PAGING_PTE_ZERO_MASK | PAGING_PTE_COW_MASK))
+    return 0;   /* the zero frame stays, shared frames were let go */
+  else if (PAGING_PAGE_PRESENT(pte) &&
+           caller->krnl->mram->fdesc[PAGING_FPN(pte)].shm != 0)
+    return 0;   /* segment frames stay with their segment */
+  else if (PAGING_PAGE_PRESENT(pte))
+  {
+    delist_pgn_node(caller->mm, PAGING_FPN(pte));
+    MEMPHY_put_freefp(caller->krnl->mram, PAGING_FPN(pte));
+    if (pte & PAGING_PTE_SWPCOPY_MASK)
+      MEMPHY_put_freefp(&caller->krnl->mswp[PAGING_SWPCOPY_TYP(pte)],
+                        PAGING_SWPCOPY(pte));
+  }
+  return 0;
+}
+#endif
+
 int free_pcb_memph(struct pcb_t *caller)
 {
-  pthread_mutex_lock(&mmvm_lock);
+#ifdef MM64
+  pthread_mutex_lock(&caller->mm->lock);
+  pthread_mutex_lock(&caller->krnl->mmvm_lock);
+
+  /* Other threads still run in it */
+  if (--caller->mm->users > 0)
+  {
+    pthread_mutex_unlock(&caller->krnl->mmvm_lock);
+    pthread_mutex_unlock(&caller->mm->lock);
+    return 0;
+  }
+
+  /* Only the mapped pages are visited, then the tables go. Each
+   * frame leaves the FIFO as it is freed */
+  frame_unmap_mm(caller->krnl, caller->mm);
+  pgtbl_for_each(caller->mm, free_pte_frame, caller);
+  shm_detach_mm(caller->krnl, caller->mm);
+  caller->mm->policy->release(caller->mm);
+  mm_unlink(caller->krnl, caller->mm);
+  pgtbl_free(caller->mm);
+  tlb_flush_asid(caller->krnl, caller->mm->asid);
+
+  /* Nobody tries it again, that takes the mmvm_lock first */
+  pthread_mutex_unlock(&caller->mm->lock);
+  pthread_mutex_destroy(&caller->mm->lock);
+#else
   int pagenum, fpn;
   uint32_t pte;
 
-  for (pagenum = 0; pagenum < PAGING_MAX_PGN; pagenum++)
+  pthread_mutex_lock(&caller->krnl->mmvm_lock);
+  for (pagenum = 0; caller->mm->pgd != NULL && pagenum < PAGING_MAX_PGN; pagenum++)
   {
     pte = caller->mm->pgd[pagenum];
     if (PAGING_PAGE_PRESENT(pte)) {
@@ -449,35 +1063,41 @@ int free_pcb_memph(struct pcb_t *caller)
       MEMPHY_put_freefp(caller->krnl->active_mswp, fpn);
     }
   }
-  pthread_mutex_unlock(&mmvm_lock);
+#endif
+  pthread_mutex_unlock(&caller->krnl->mmvm_lock);
   return 0;
 }
 
 /*find_victim_page - find victim page
- *@caller: caller
+ *@krnl: kernel, for the TLB shootdowns of the policy
+ *@mm: memory map
  *@pgn: return page number
  *
+ * The replacement policy of mm picks the page and takes it off. The
+ * 32-bit paging takes the oldest page of its FIFO, kept newest first
  */
-int find_victim_page(struct mm_struct *mm, addr_t *retpgn)
+#ifdef MM64
+int find_victim_page(struct krnl_t *krnl, struct mm_struct *mm, addr_t *retpgn)
 {
-  struct pgn_t *pg = mm->fifo_pgn;
+  return mm->policy->victim(krnl, mm, retpgn);
+}
+#else
+int find_victim_page(struct krnl_t *krnl, struct mm_struct *mm, addr_t *retpgn)
+{
+  struct pgn_t *pg = mm->fifo_pgn, **pp = &mm->fifo_pgn;
+
   if (pg == NULL) return -1;
-  if (pg->pg_next == NULL) {
-    *retpgn = pg->pgn;
-    mm->fifo_pgn = NULL;
-    free(pg);
-    return 0;
-  }
-  struct pgn_t *prev = NULL;
-  while (pg->pg_next != NULL) {
-    prev = pg;
+  while (pg->pg_next != NULL)
+  {
+    pp = &pg->pg_next;
     pg = pg->pg_next;
   }
   *retpgn = pg->pgn;
-  if (prev != NULL) prev->pg_next = NULL;
+  *pp = NULL;
   free(pg);
   return 0;
 }
+#endif
 
 /*get_free_vmrg_area - get a free vm region
  *@caller: caller
@@ -4,8 +4,6 @@
 #include <stdlib.h>
 #include <string.h>
 
-static uint32_t avail_pid = 1;
-
 #define OPT_CALC	"calc"
 #define OPT_ALLOC	"alloc"
 #define OPT_FREE	"free"
@@ -32,11 +30,15 @@ static enum ins_opcode_t get_opcode(char * opt) {
 	}
 }
 
-struct pcb_t * load(const char * path) {
+struct pcb_t * load(struct krnl_t * krnl, const char * path) {
 	/* Create new PCB for the new process */
 	struct pcb_t * proc = (struct pcb_t * )malloc(sizeof(struct pcb_t));
-	proc->pid = avail_pid;
-	avail_pid++;
+	/* A fork may take a PID at the same time */
+	pthread_mutex_lock(&krnl->queue_lock);
+	proc->pid = krnl->avail_pid;
+	krnl->avail_pid++;
+	pthread_mutex_unlock(&krnl->queue_lock);
+	proc->krnl = krnl;
 	proc->page_table =
 		(struct page_table_t*)malloc(sizeof(struct page_table_t));
 	proc->bp = PAGE_SIZE;
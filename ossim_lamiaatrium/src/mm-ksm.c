@@ -0,0 +1,516 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+/*
+ * PAGING based Memory Management
+ * Shared frames and same page merging mm/mm-ksm.c
+ *
+ * A RAM frame may back pages of several address spaces at once. Their
+ * PTEs carry the COW bit, so the TLB refuses writes through them and
+ * the first write copies the frame, see pg_getpage. The descriptor of
+ * a shared frame keeps the pages mapping it on its reverse map; one of
+ * them lists the frame for the replacement policy, and reclaim swaps
+ * every one of them out before it takes the frame.
+ *
+ * ksmd feeds it: it checksums a few frames per time slot and maps a
+ * page whose content held still over a whole pass onto a frame that
+ * holds the same bytes, freeing its own. A page of zeroes goes to the
+ * zero frame instead. All of it runs under the mmvm_lock; a page
+ * table is only changed under the lock of its mm too, which ksmd
+ * tries and passes a busy mm over.
+ */
+
+#include "mm.h"
+#include "mm64.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(MM64)
+
+static void rmap_add(struct memphy_struct *mp, addr_t fpn,
+                     struct mm_struct *mm, addr_t pgn)
+{
+  struct rmap_t *r = malloc(sizeof(struct rmap_t));
+
+  r->mm = mm;
+  r->pgn = pgn;
+  r->next = mp->fdesc[fpn].rmap;
+  mp->fdesc[fpn].rmap = r;
+  mp->fdesc[fpn].nref++;
+}
+
+/*
+ * rmap_del - take a page off the reverse map of a frame, nothing else
+ */
+void rmap_del(struct memphy_struct *mp, addr_t fpn,
+              struct mm_struct *mm, addr_t pgn)
+{
+  struct rmap_t **pp, *r;
+
+  for (pp = &mp->fdesc[fpn].rmap; (r = *pp) != NULL; pp = &r->next)
+  {
+    if (r->mm == mm && r->pgn == pgn)
+    {
+      *pp = r->next;
+      free(r);
+      mp->fdesc[fpn].nref--;
+      return;
+    }
+  }
+}
+
+/* Point a PTE at a shared frame. A swap copy of the old content is
+ * dropped, it would not be the copy of the other pages */
+static void pte_make_shared(struct krnl_t *krnl, struct mm_struct *mm,
+                            addr_t pgn, addr_t fpn)
+{
+  uint64_t pte = pgtbl_load(mm, pgn);
+
+  if (PAGING_PAGE_PRESENT(pte) && (pte & PAGING_PTE_SWPCOPY_MASK))
+    MEMPHY_put_freefp(&krnl->mswp[PAGING_SWPCOPY_TYP(pte)], PAGING_SWPCOPY(pte));
+
+  pte = (pte & PAGING_PTE_ACCESSED_MASK) | PAGING_PTE_PRESENT_MASK |
+        PAGING_PTE_COW_MASK | fpn;
+  tlb_shootdown(krnl, mm->asid, pgn);
+  pgtbl_store(mm, pgn, pte);
+}
+
+/*
+ * frame_share - map a page read only onto a frame
+ * @krnl: kernel
+ * @fpn: frame, private or shared already
+ * @mm: address space of the page
+ * @pgn: the page, whatever it mapped is the business of the caller
+ *
+ * The page of a private frame becomes its first sharer and keeps
+ * listing it
+ */
+int frame_share(struct krnl_t *krnl, addr_t fpn, struct mm_struct *mm, addr_t pgn)
+{
+  struct memphy_struct *mram = krnl->mram;
+  struct framedesc_t *fd = &mram->fdesc[fpn];
+
+  if (fd->nref == 0)
+  {
+    if (fd->owner == NULL)
+      return -1;
+    pte_make_shared(krnl, fd->owner, fd->pgn, fpn);
+    rmap_add(mram, fpn, fd->owner, fd->pgn);
+  }
+
+  pte_make_shared(krnl, mm, pgn, fpn);
+  rmap_add(mram, fpn, mm, pgn);
+  return 0;
+}
+
+/*
+ * frame_settle - restore the shape of a shared frame after pages left
+ * @krnl: kernel
+ * @fpn: frame
+ *
+ * The last page left gets the frame as a private one, writable again,
+ * unless its mm is busy in another thread: the frame then stays
+ * shared by that one page until it writes or leaves. A frame still
+ * shared but no longer listed is listed by a sharer
+ */
+void frame_settle(struct krnl_t *krnl, addr_t fpn)
+{
+  struct framedesc_t *fd = &krnl->mram->fdesc[fpn];
+  struct rmap_t *r = fd->rmap;
+  struct mm_struct *mm = (r != NULL) ? r->mm : NULL;
+
+  if (fd->nref == 1 && pthread_mutex_trylock(&mm->lock) == 0)
+  {
+    if (fd->owner != NULL)
+      delist_pgn_node(fd->owner, fpn);
+    tlb_shootdown(krnl, mm->asid, r->pgn);
+    pgtbl_update(mm, r->pgn, 0, PAGING_PTE_COW_MASK);
+    enlist_pgn_node(mm, r->pgn, fpn);
+    pthread_mutex_unlock(&mm->lock);
+    free(r);
+    fd->rmap = NULL;
+    fd->nref = 0;
+    ksm_forget(krnl, fpn);
+  }
+  else if (fd->nref > 0 && fd->owner == NULL)
+    enlist_pgn_node(mm, r->pgn, fpn);
+}
+
+/*
+ * frame_unmap - a page stops using a shared frame
+ * @krnl: kernel
+ * @fpn: frame
+ * @mm: address space of the page
+ * @pgn: the page, its PTE is left to the caller
+ *
+ * The frame is freed once no page uses it
+ */
+void frame_unmap(struct krnl_t *krnl, addr_t fpn, struct mm_struct *mm, addr_t pgn)
+{
+  struct framedesc_t *fd = &krnl->mram->fdesc[fpn];
+
+  rmap_del(krnl->mram, fpn, mm, pgn);
+  if (fd->owner == mm && fd->pgn == pgn)
+    delist_pgn_node(mm, fpn);
+
+  if (fd->nref == 0)
+  {
+    ksm_forget(krnl, fpn);
+    MEMPHY_put_freefp(krnl->mram, fpn);
+  }
+  else
+    frame_settle(krnl, fpn);
+}
+
+/*
+ * frame_unmap_mm - every page of an exiting address space stops using
+ * the shared frames
+ *
+ * All of them leave before any frame is settled, so none is handed
+ * back to a page of the same mm that is about to go
+ */
+void frame_unmap_mm(struct krnl_t *krnl, struct mm_struct *mm)
+{
+  struct memphy_struct *mram = krnl->mram;
+  struct rmap_t **pp, *r;
+  addr_t fpn;
+
+  for (fpn = 0; fpn < mram->numfp; fpn++)
+  {
+    struct framedesc_t *fd = &mram->fdesc[fpn];
+    if (fd->nref == 0)
+      continue;
+
+    for (pp = &fd->rmap; (r = *pp) != NULL; )
+    {
+      if (r->mm != mm)
+      {
+        pp = &r->next;
+        continue;
+      }
+      if (fd->owner == mm && fd->pgn == r->pgn)
+        delist_pgn_node(mm, fpn);
+      *pp = r->next;
+      free(r);
+      fd->nref--;
+    }
+
+    if (fd->nref == 0)
+    {
+      ksm_forget(krnl, fpn);
+      MEMPHY_put_freefp(mram, fpn);
+    }
+    else
+      frame_settle(krnl, fpn);
+  }
+}
+
+static int rmap_add_pte(addr_t pgn, uint64_t pte, void *arg)
+{
+  struct mm_struct *mm = (struct mm_struct *)arg;
+
+  if (PAGING_PAGE_PRESENT(pte) && (pte & PAGING_PTE_COW_MASK) &&
+      !(pte & PAGING64_PTE_HUGE_MASK))
+    rmap_add(mm->frm_mp, PAGING_FPN(pte), mm, pgn);
+  return 0;
+}
+
+/*
+ * rmap_rebuild - fill the reverse maps from the COW bits of the PTEs,
+ * after a snapshot restore
+ */
+int rmap_rebuild(struct krnl_t *krnl)
+{
+  struct mm_struct *mm;
+
+  for (mm = krnl->mm_list; mm != NULL; mm = mm->mm_next)
+    pgtbl_for_each(mm, rmap_add_pte, mm);
+  if (krnl->ksm != NULL)
+    ksm_rehash(krnl);
+  return 0;
+}
+
+/*
+ * Same page merging
+ */
+static uint32_t ksm_csum(const BYTE *pg)
+{
+  uint32_t h = 2166136261u;
+  addr_t i;
+
+  for (i = 0; i < PAGING64_PAGESZ; i++)
+    h = (h ^ pg[i]) * 16777619u;
+  return h;
+}
+
+static BYTE *ksm_frame(struct krnl_t *krnl, addr_t fpn)
+{
+  return krnl->mram->storage + fpn * PAGING64_PAGESZ;
+}
+
+/* A private 4K page of a resident frame, what ksmd may merge */
+static int ksm_candidate(struct krnl_t *krnl, addr_t fpn)
+{
+  struct framedesc_t *fd = &krnl->mram->fdesc[fpn];
+  uint64_t pte;
+
+  if (fd->owner == NULL || fd->nref > 0)
+    return 0;
+  pte = pgtbl_load(fd->owner, fd->pgn);
+  return PAGING_PAGE_PRESENT(pte) && !(pte & PAGING64_PTE_HUGE_MASK) &&
+         !(pte & (PAGING_PTE_ZERO_MASK | PAGING_PTE_COW_MASK)) &&
+         PAGING_FPN(pte) == fpn;
+}
+
+int ksm_init(struct ksm_t *ks, addr_t numfp)
+{
+  addr_t i;
+
+  memset(ks, 0, sizeof(struct ksm_t));
+  ks->nbucket = numfp;
+  ks->csum = calloc(numfp, sizeof(uint32_t));
+  ks->state = calloc(numfp, sizeof(uint8_t));
+  ks->bucket = malloc(numfp * sizeof(addr_t));
+  ks->hnext = malloc(numfp * sizeof(addr_t));
+  if (ks->csum == NULL || ks->state == NULL || ks->bucket == NULL ||
+      ks->hnext == NULL)
+    return -1;
+  for (i = 0; i < numfp; i++)
+    ks->bucket[i] = ks->hnext[i] = FRAME_NIL;
+  return 0;
+}
+
+void ksm_destroy(struct ksm_t *ks)
+{
+  free(ks->csum);
+  free(ks->state);
+  free(ks->bucket);
+  free(ks->hnext);
+  ks->csum = NULL;
+  ks->state = NULL;
+  ks->bucket = ks->hnext = NULL;
+  ks->nbucket = 0;
+}
+
+static void ksm_insert(struct ksm_t *ks, addr_t fpn, int state)
+{
+  addr_t b = ks->csum[fpn] % ks->nbucket;
+
+  ks->hnext[fpn] = ks->bucket[b];
+  ks->bucket[b] = fpn;
+  ks->state[fpn] = state;
+}
+
+/*
+ * ksm_forget - a frame stops being shared, take it out of the table
+ */
+void ksm_forget(struct krnl_t *krnl, addr_t fpn)
+{
+  struct ksm_t *ks = krnl->ksm;
+  addr_t *pp;
+
+  if (ks == NULL || ks->state[fpn] != KSM_STABLE)
+    return;
+  for (pp = &ks->bucket[ks->csum[fpn] % ks->nbucket]; *pp != FRAME_NIL;
+       pp = &ks->hnext[*pp])
+  {
+    if (*pp == fpn)
+    {
+      *pp = ks->hnext[fpn];
+      break;
+    }
+  }
+  ks->state[fpn] = KSM_NONE;
+}
+
+/*
+ * ksm_rehash - start a new pass, the table only keeps the shared
+ * frames
+ */
+void ksm_rehash(struct krnl_t *krnl)
+{
+  struct ksm_t *ks = krnl->ksm;
+  uint64_t saved = 0;
+  addr_t fpn;
+
+  for (fpn = 0; fpn < ks->nbucket; fpn++)
+    ks->bucket[fpn] = FRAME_NIL;
+  for (fpn = 0; fpn < ks->nbucket; fpn++)
+  {
+    uint32_t nref = krnl->mram->fdesc[fpn].nref;
+    ks->state[fpn] = KSM_NONE;
+    if (nref > 0)
+    {
+      ks->csum[fpn] = ksm_csum(ksm_frame(krnl, fpn));
+      ksm_insert(ks, fpn, KSM_STABLE);
+      saved += nref - 1;
+    }
+  }
+  if (saved > ks->max_saved)
+    ks->max_saved = saved;
+}
+
+/*
+ * ksm_lookup - find another frame holding the bytes of fpn. Stale
+ * candidates met on the way are dropped. An unstable one is private,
+ * its page may be written: it is only compared under the lock of its
+ * owner, a busy owner leaves it for later. It is returned with that
+ * lock held
+ */
+static addr_t ksm_lookup(struct krnl_t *krnl, addr_t fpn, uint32_t sum)
+{
+  struct ksm_t *ks = krnl->ksm;
+  struct mm_struct *owner;
+  addr_t *pp, f;
+
+  for (pp = &ks->bucket[sum % ks->nbucket]; (f = *pp) != FRAME_NIL; )
+  {
+    owner = NULL;
+    if (f == fpn || ks->csum[f] != sum)
+    {
+      pp = &ks->hnext[f];
+      continue;
+    }
+    if (ks->state[f] == KSM_UNSTABLE)
+    {
+      owner = krnl->mram->fdesc[f].owner;
+      if (owner != NULL && pthread_mutex_trylock(&owner->lock) != 0)
+      {
+        pp = &ks->hnext[f];
+        continue;
+      }
+      if (owner == NULL || !ksm_candidate(krnl, f))
+      {
+        if (owner != NULL)
+          pthread_mutex_unlock(&owner->lock);
+        *pp = ks->hnext[f];
+        ks->state[f] = KSM_NONE;
+        continue;
+      }
+    }
+    if (memcmp(ksm_frame(krnl, f), ksm_frame(krnl, fpn), PAGING64_PAGESZ) == 0)
+      return f;
+    if (owner != NULL)
+      pthread_mutex_unlock(&owner->lock);
+    pp = &ks->hnext[f];
+  }
+  return FRAME_NIL;
+}
+
+/* Give up a private frame, its page now maps somewhere else */
+static void ksm_release(struct krnl_t *krnl, addr_t fpn)
+{
+  struct framedesc_t *fd = &krnl->mram->fdesc[fpn];
+
+  delist_pgn_node(fd->owner, fpn);
+  MEMPHY_put_freefp(krnl->mram, fpn);
+}
+
+/* The page of fpn merged or left alone, the lock of its owner is held */
+static void ksm_merge_frame(struct krnl_t *krnl, addr_t fpn)
+{
+  struct ksm_t *ks = krnl->ksm;
+  struct framedesc_t *fd = &krnl->mram->fdesc[fpn];
+  struct mm_struct *mm = fd->owner, *kowner;
+  addr_t pgn = fd->pgn, kfpn;
+  BYTE *pg = ksm_frame(krnl, fpn);
+  uint64_t pte;
+  uint32_t sum;
+
+  if (!ksm_candidate(krnl, fpn))
+    return;
+
+  /* A page still being written is left for the next pass */
+  sum = ksm_csum(pg);
+  if (sum != ks->csum[fpn])
+  {
+    ks->csum[fpn] = sum;
+    return;
+  }
+
+  if (PAGING_HAS_ZERO_FRAME(krnl->mram) &&
+      pg[0] == 0 && memcmp(pg, pg + 1, PAGING64_PAGESZ - 1) == 0)
+  {
+    pte = pgtbl_load(mm, pgn);
+    if (pte & PAGING_PTE_SWPCOPY_MASK)
+      MEMPHY_put_freefp(&krnl->mswp[PAGING_SWPCOPY_TYP(pte)], PAGING_SWPCOPY(pte));
+    ksm_release(krnl, fpn);
+    tlb_shootdown(krnl, mm->asid, pgn);
+    pgtbl_store(mm, pgn, PAGING_PTE_PRESENT_MASK | PAGING_PTE_ZERO_MASK |
+                         PAGING_ZERO_FPN);
+    ks->nr_zero++;
+    return;
+  }
+
+  if ((kfpn = ksm_lookup(krnl, fpn, sum)) == FRAME_NIL)
+  {
+    ksm_insert(ks, fpn, KSM_UNSTABLE);
+    return;
+  }
+
+  kowner = (ks->state[kfpn] == KSM_UNSTABLE) ? krnl->mram->fdesc[kfpn].owner : NULL;
+  if (frame_share(krnl, kfpn, mm, pgn) == 0)
+  {
+    ksm_release(krnl, fpn);
+    ks->state[kfpn] = KSM_STABLE;
+    ks->nr_merge++;
+  }
+  if (kowner != NULL)
+    pthread_mutex_unlock(&kowner->lock);
+}
+
+/*
+ * ksm_scan_frame - look at one frame. The mmvm_lock is held, the lock
+ * of the owner is only tried: a page of a busy mm waits for the next
+ * pass
+ */
+static void ksm_scan_frame(struct krnl_t *krnl, addr_t fpn)
+{
+  struct mm_struct *mm = krnl->mram->fdesc[fpn].owner;
+
+  if (mm == NULL || pthread_mutex_trylock(&mm->lock) != 0)
+    return;
+  ksm_merge_frame(krnl, fpn);
+  pthread_mutex_unlock(&mm->lock);
+}
+
+/*
+ * ksm_scan - ksmd work of one time slot
+ * @krnl: kernel
+ * @nr: frames to scan
+ *
+ * Return the pages merged
+ */
+int ksm_scan(struct krnl_t *krnl, int nr)
+{
+  struct ksm_t *ks = krnl->ksm;
+  uint64_t before;
+
+  if (ks == NULL || ks->nbucket == 0)
+    return 0;
+
+  pthread_mutex_lock(&krnl->mmvm_lock);
+  before = ks->nr_merge + ks->nr_zero;
+  while (nr-- > 0)
+  {
+    ksm_scan_frame(krnl, ks->cursor);
+    if (++ks->cursor == ks->nbucket)
+    {
+      ks->cursor = 0;
+      ks->nr_pass++;
+      ksm_rehash(krnl);
+    }
+  }
+  pthread_mutex_unlock(&krnl->mmvm_lock);
+  return ks->nr_merge + ks->nr_zero - before;
+}
+
+#endif  //def MM64
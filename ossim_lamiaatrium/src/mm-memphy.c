@@ -19,21 +19,105 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(MEMPHY_NT_STORE) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /*
  *  MEMPHY_mv_csr - move MEMPHY cursor
  *  @mp: memphy struct
  *  @offset: offset
+ *
+ *  The cursor is placed directly, the move is only charged
+ *  to the simulated device time
  */
 int MEMPHY_mv_csr(struct memphy_struct *mp, addr_t offset)
 {
-   int numstep = 0;
-   mp->cursor = 0;
-   while (numstep < offset && numstep < mp->maxsz)
+   addr_t dist;
+
+   if (mp->maxsz == 0) return -1;
+   offset %= mp->maxsz;
+   if (offset == mp->cursor) return 0;
+
+   dist = (offset > mp->cursor) ? offset - mp->cursor : mp->cursor - offset;
+   mp->busy_ns += mp->seek_ns + (dist * mp->seek_ns_per_mb >> 20);
+   mp->nseek++;
+   mp->cursor = offset;
+   return 0;
+}
+
+/*
+ *  MEMPHY_seq_xfer - account a transfer on a sequential device
+ *  @mp: memphy struct
+ *  @addr: first byte
+ *  @len: number of bytes, the cursor ends right after them
+ */
+int MEMPHY_seq_xfer(struct memphy_struct *mp, addr_t addr, addr_t len)
+{
+   if (mp->rdmflg) return 0;
+
+   MEMPHY_mv_csr(mp, addr);
+   mp->busy_ns += (len * mp->xfer_ns_per_kb) >> 10;
+   mp->cursor = (addr + len) % mp->maxsz;
+   return 0;
+}
+
+/*
+ *  MEMPHY_xfer_page - move one whole frame between devices
+ *  @src: source memphy
+ *  @srcfpn: source frame number
+ *  @dst: destination memphy
+ *  @dstfpn: destination frame number
+ *  @pagesz: frame size
+ *
+ *  Frames are page aligned in the device mappings, with
+ *  MEMPHY_NT_STORE the copy uses non-temporal stores so a swapped
+ *  frame does not evict the working set from the host cache
+ */
+int MEMPHY_xfer_page(struct memphy_struct *src, addr_t srcfpn,
+                     struct memphy_struct *dst, addr_t dstfpn, addr_t pagesz)
+{
+   addr_t srcaddr = srcfpn * pagesz;
+   addr_t dstaddr = dstfpn * pagesz;
+
+   if (src == NULL || dst == NULL ||
+       srcfpn >= src->numfp || dstfpn >= dst->numfp)
+      return -1;
+
+   MEMPHY_seq_xfer(src, srcaddr, pagesz);
+   MEMPHY_seq_xfer(dst, dstaddr, pagesz);
+
+#if defined(MEMPHY_NT_STORE) && defined(__SSE2__)
    {
-      mp->cursor = (mp->cursor + 1) % mp->maxsz;
-      numstep++;
+      const __m128i *s = (const __m128i *)(src->storage + srcaddr);
+      __m128i *d = (__m128i *)(dst->storage + dstaddr);
+      addr_t i;
+
+      for (i = 0; i < pagesz / sizeof(__m128i); i++)
+         _mm_stream_si128(d + i, _mm_load_si128(s + i));
+      _mm_sfence();
    }
+#else
+   memcpy(dst->storage + dstaddr, src->storage + srcaddr, pagesz);
+#endif
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_set_seqcost - set the simulated cost of a sequential device
+ *  @mp: memphy struct
+ */
+int MEMPHY_set_seqcost(struct memphy_struct *mp, uint64_t seek_ns,
+                       uint64_t seek_ns_per_mb, uint64_t xfer_ns_per_kb)
+{
+   mp->seek_ns = seek_ns;
+   mp->seek_ns_per_mb = seek_ns_per_mb;
+   mp->xfer_ns_per_kb = xfer_ns_per_kb;
    return 0;
 }
 
@@ -46,8 +130,8 @@ int MEMPHY_mv_csr(struct memphy_struct *mp, addr_t offset)
 int MEMPHY_seq_read(struct memphy_struct *mp, addr_t addr, BYTE *value)
 {
    if (mp == NULL) return -1;
-   if (!mp->rdmflg) return -1; 
-   MEMPHY_mv_csr(mp, addr);
+   if (mp->rdmflg || addr >= mp->maxsz) return -1;
+   MEMPHY_seq_xfer(mp, addr, 1);
    *value = (BYTE)mp->storage[addr];
    return 0;
 }
@@ -84,8 +168,8 @@ int MEMPHY_read(struct memphy_struct *mp, addr_t addr, BYTE *value)
 int MEMPHY_seq_write(struct memphy_struct *mp, addr_t addr, BYTE value)
 {
    if (mp == NULL) return -1;
-   if (!mp->rdmflg) return -1; 
-   MEMPHY_mv_csr(mp, addr);
+   if (mp->rdmflg || addr >= mp->maxsz) return -1;
+   MEMPHY_seq_xfer(mp, addr, 1);
    mp->storage[addr] = value;
    return 0;
 }
@@ -113,45 +197,222 @@ int MEMPHY_write(struct memphy_struct *mp, addr_t addr, BYTE data)
    return 0;
 }
 
+#define FPMAP_WORD(fpn) ((fpn) / 64)
+#define FPMAP_BIT(fpn)  BIT_ULL((fpn) % 64)
+
 /*
  *  MEMPHY_format-format MEMPHY device
  *  @mp: memphy struct
+ *
+ *  The free frames are kept in a single array used as a stack,
+ *  filled so that frames are handed out from fpn 0 upward. The
+ *  free map mirrors it a bit per frame, for the searches of runs.
+ *  The descriptors, the map, the stack and the stack positions are
+ *  carved out of one allocation, in that order of alignment
  */
 int MEMPHY_format(struct memphy_struct *mp, int pagesz)
 {
-   int numfp = mp->maxsz / pagesz;
-   struct framephy_struct *newfst, *fst;
-   int iter = 0;
+   addr_t numfp = mp->maxsz / pagesz;
+   addr_t nword = DIV_ROUND_UP(numfp, 64);
+   addr_t iter;
 
-   if (numfp <= 0) return -1;
+   mp->numfp = 0;
+   mp->free_fp_top = 0;
+   if (numfp == 0) return -1;
 
-   fst = malloc(sizeof(struct framephy_struct));
-   fst->fpn = iter;
-   mp->free_fp_list = fst;
+   mp->fdesc = malloc(numfp * sizeof(struct framedesc_t) +
+                      nword * sizeof(uint64_t) + 2 * numfp * sizeof(addr_t));
+   if (mp->fdesc == NULL) return -1;
+   mp->free_fp_map = (uint64_t *)(mp->fdesc + numfp);
+   mp->free_fp_stack = (addr_t *)(mp->free_fp_map + nword);
+   mp->free_fp_pos = mp->free_fp_stack + numfp;
+   memset(mp->free_fp_map, 0, nword * sizeof(uint64_t));
 
-   for (iter = 1; iter < numfp; iter++)
+   for (iter = 0; iter < numfp; iter++)
    {
-      newfst = malloc(sizeof(struct framephy_struct));
-      newfst->fpn = iter;
-      newfst->fp_next = NULL;
-      fst->fp_next = newfst;
-      fst = newfst;
+      mp->free_fp_stack[iter] = numfp - 1 - iter;
+      mp->free_fp_pos[numfp - 1 - iter] = iter;
+      mp->free_fp_map[FPMAP_WORD(iter)] |= FPMAP_BIT(iter);
+      mp->fdesc[iter].owner = NULL;
+      mp->fdesc[iter].prev = mp->fdesc[iter].next = FRAME_NIL;
+      mp->fdesc[iter].nref = 0;
+      mp->fdesc[iter].rmap = NULL;
+      mp->fdesc[iter].shm = 0;
    }
 
+   mp->numfp = numfp;
+   mp->free_fp_top = numfp;
+   mp->clust_next = 0;
+
    return 0;
 }
 
+/*
+ *  MEMPHY_clear_freefp - mark every frame used, the free stack is then
+ *  rebuilt with MEMPHY_put_freefp
+ *  @mp: memphy struct
+ */
+void MEMPHY_clear_freefp(struct memphy_struct *mp)
+{
+   addr_t iter;
+
+   for (iter = 0; iter < mp->numfp; iter++)
+      mp->free_fp_pos[iter] = FRAME_NIL;
+   for (iter = 0; iter < DIV_ROUND_UP(mp->numfp, 64); iter++)
+      mp->free_fp_map[iter] = 0;
+   mp->free_fp_top = 0;
+}
+
 int MEMPHY_get_freefp(struct memphy_struct *mp, addr_t *retfpn)
 {
-   struct framephy_struct *fp = mp->free_fp_list;
-   if (fp == NULL) return -1;
-   *retfpn = fp->fpn;
-   mp->free_fp_list = fp->fp_next;
+   if (mp->free_fp_top == 0) return -1;
 
-   /* MEMPHY is iteratively used up until its exhausted
-    * No garbage collector acting then it not been released
-    */
-   free(fp);
+   *retfpn = mp->free_fp_stack[--mp->free_fp_top];
+   mp->free_fp_pos[*retfpn] = FRAME_NIL;
+   mp->free_fp_map[FPMAP_WORD(*retfpn)] &= ~FPMAP_BIT(*retfpn);
+   return 0;
+}
+
+/*
+ *  MEMPHY_is_freefp - tell whether a frame is free
+ *  @mp: memphy struct
+ *  @fpn: frame, anything out of range is not
+ */
+int MEMPHY_is_freefp(struct memphy_struct *mp, addr_t fpn)
+{
+   return fpn < mp->numfp && mp->free_fp_pos[fpn] != FRAME_NIL;
+}
+
+/*
+ *  MEMPHY_take_freefp - take a given free frame out of the stack
+ *  @mp: memphy struct
+ *  @fpn: frame, must be free
+ */
+static void MEMPHY_take_freefp(struct memphy_struct *mp, addr_t fpn)
+{
+   addr_t pos = mp->free_fp_pos[fpn];
+   addr_t last = mp->free_fp_stack[--mp->free_fp_top];
+
+   /* The top fills the hole */
+   mp->free_fp_stack[pos] = last;
+   mp->free_fp_pos[last] = pos;
+   mp->free_fp_pos[fpn] = FRAME_NIL;
+   mp->free_fp_map[FPMAP_WORD(fpn)] &= ~FPMAP_BIT(fpn);
+}
+
+/*
+ *  MEMPHY_run_free - tell whether nfp frames from base are all free,
+ *  a word of the free map at a time
+ */
+static int MEMPHY_run_free(struct memphy_struct *mp, addr_t base, addr_t nfp)
+{
+   addr_t fpn = base, end = base + nfp, n;
+   uint64_t mask;
+
+   while (fpn < end)
+   {
+      n = 64 - fpn % 64;
+      if (n > end - fpn)
+         n = end - fpn;
+      mask = (n == 64) ? ~0ULL : (BIT_ULL(n) - 1) << (fpn % 64);
+      if ((mp->free_fp_map[FPMAP_WORD(fpn)] & mask) != mask)
+         return 0;
+      fpn += n;
+   }
+   return 1;
+}
+
+/*
+ *  MEMPHY_get_freefp_near - take a free frame close to a hint
+ *  @mp: memphy struct
+ *  @hint: preferred frame, FRAME_NIL if none
+ *  @nclust: cluster size
+ *  @retfpn: frame taken
+ *
+ *  The hint is taken when free. Else a new run starts at the first
+ *  frame of an aligned cluster of nclust free frames, the cursor goes
+ *  round the device looking for one. The frames after it are left for
+ *  the hints of the following pages, so runs evicted side by side by
+ *  different processes do not interleave. Any frame does when no
+ *  cluster is whole
+ */
+int MEMPHY_get_freefp_near(struct memphy_struct *mp, addr_t hint,
+                           addr_t nclust, addr_t *retfpn)
+{
+   addr_t base, n;
+
+   if (mp->free_fp_top == 0) return -1;
+
+   if (MEMPHY_is_freefp(mp, hint))
+   {
+      MEMPHY_take_freefp(mp, hint);
+      *retfpn = hint;
+      return 0;
+   }
+
+   if (nclust > 0 && nclust <= mp->numfp)
+   {
+      base = mp->clust_next;
+      for (n = mp->numfp / nclust; n > 0; n--)
+      {
+         if (base + nclust > mp->numfp)
+            base = 0;
+         if (MEMPHY_run_free(mp, base, nclust))
+         {
+            mp->clust_next = base + nclust;
+            MEMPHY_take_freefp(mp, base);
+            *retfpn = base;
+            return 0;
+         }
+         base += nclust;
+      }
+   }
+
+   return MEMPHY_get_freefp(mp, retfpn);
+}
+
+/*
+ *  MEMPHY_get_freefp_range - take an aligned run of free frames
+ *  @mp: memphy struct
+ *  @nfp: number of frames, also the alignment of the first one
+ *  @retfpn: first frame of the run
+ *
+ *  The run is looked up in the free map and its frames taken out of
+ *  the stack one by one. Return -1 when memory is too fragmented to
+ *  hold such a run
+ */
+int MEMPHY_get_freefp_range(struct memphy_struct *mp, addr_t nfp, addr_t *retfpn)
+{
+   addr_t i, base;
+
+   if (nfp == 0 || mp->free_fp_top < nfp) return -1;
+
+   for (base = 0; base + nfp <= mp->numfp; base += nfp)
+   {
+      if (!MEMPHY_run_free(mp, base, nfp))
+         continue;
+      for (i = 0; i < nfp; i++)
+         MEMPHY_take_freefp(mp, base + i);
+      *retfpn = base;
+      return 0;
+   }
+   return -1;
+}
+
+/*
+ *  MEMPHY_clear_frames - fill consecutive frames with zeroes
+ *  @mp: memphy struct
+ *  @fpn: first frame
+ *  @nfp: number of frames
+ *  @pagesz: frame size
+ */
+int MEMPHY_clear_frames(struct memphy_struct *mp, addr_t fpn, addr_t nfp,
+                        addr_t pagesz)
+{
+   if (mp == NULL || mp->storage == NULL || fpn + nfp > mp->numfp)
+      return -1;
+
+   memset(mp->storage + fpn * pagesz, 0, nfp * pagesz);
    return 0;
 }
 
@@ -164,23 +425,30 @@ int MEMPHY_dump(struct memphy_struct *mp)
 
 int MEMPHY_put_freefp(struct memphy_struct *mp, addr_t fpn)
 {
-   struct framephy_struct *fp = mp->free_fp_list;
-   struct framephy_struct *newnode = malloc(sizeof(struct framephy_struct));
-   newnode->fpn = fpn;
-   newnode->fp_next = fp;
-   mp->free_fp_list = newnode;
+   if (fpn >= mp->numfp || mp->free_fp_top >= mp->numfp ||
+       mp->free_fp_pos[fpn] != FRAME_NIL) return -1;
+
+   mp->free_fp_pos[fpn] = mp->free_fp_top;
+   mp->free_fp_stack[mp->free_fp_top++] = fpn;
+   mp->free_fp_map[FPMAP_WORD(fpn)] |= FPMAP_BIT(fpn);
    return 0;
 }
 
 /*
- *  Init MEMPHY struct
+ *  MEMPHY_setup - common part of the MEMPHY initializers
+ *  @mp: memphy struct
+ *  @storage: mapped backing store of max_size bytes
  */
-int init_memphy(struct memphy_struct *mp, addr_t max_size, int randomflg)
+static int MEMPHY_setup(struct memphy_struct *mp, BYTE *storage,
+                        addr_t max_size, int randomflg)
 {
-   mp->storage = (BYTE *)malloc(max_size * sizeof(BYTE));
+   mp->storage = storage;
    mp->maxsz = max_size;
-   mp->free_fp_list = NULL;
-   memset(mp->storage, 0, max_size * sizeof(BYTE));
+   mp->path = NULL;
+   mp->free_fp_stack = NULL;
+   mp->free_fp_pos = NULL;
+   mp->free_fp_map = NULL;
+   mp->fdesc = NULL;
 
 #ifdef MM64
    MEMPHY_format(mp, PAGING64_PAGESZ);
@@ -189,7 +457,117 @@ int init_memphy(struct memphy_struct *mp, addr_t max_size, int randomflg)
 #endif
 
    mp->rdmflg = (randomflg != 0) ? 1 : 0;
-   if (!mp->rdmflg) mp->cursor = 0;
+   mp->cursor = 0;
+   mp->busy_ns = 0;
+   mp->nseek = 0;
+   MEMPHY_set_seqcost(mp, MEMPHY_SEEK_NS, MEMPHY_SEEK_NS_PER_MB,
+                      MEMPHY_XFER_NS_PER_KB);
+
+   return 0;
+}
+
+/*
+ *  Init MEMPHY struct
+ */
+int init_memphy(struct memphy_struct *mp, addr_t max_size, int randomflg)
+{
+   BYTE *storage = NULL;
+
+   /* Reserve the address range only, the host hands out zero pages
+    * on first touch so an untouched frame costs no memory */
+   if (max_size > 0)
+   {
+      void *p = mmap(NULL, max_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (p == MAP_FAILED) return -1;
+      storage = (BYTE *)p;
+   }
+
+   return MEMPHY_setup(mp, storage, max_size, randomflg);
+}
+
+/*
+ *  init_memphy_file - init MEMPHY struct backed by a host file
+ *  @mp: memphy struct
+ *  @max_size: device size, the file is extended (sparse) to it
+ *  @path: host file, created if missing
+ *
+ *  The file is mapped shared, so the device content outlives the
+ *  simulation and may exceed the host memory
+ */
+int init_memphy_file(struct memphy_struct *mp, addr_t max_size, int randomflg,
+                     const char *path)
+{
+   struct stat st;
+   void *p;
+   int fd;
+
+   if (max_size == 0) return init_memphy(mp, max_size, randomflg);
+
+   fd = open(path, O_RDWR | O_CREAT, 0644);
+   if (fd < 0) return -1;
+   if (fstat(fd, &st) != 0 ||
+       ((addr_t)st.st_size < max_size && ftruncate(fd, max_size) != 0))
+   {
+      close(fd);
+      return -1;
+   }
+
+   p = mmap(NULL, max_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if (p == MAP_FAILED) return -1;
+
+   MEMPHY_setup(mp, (BYTE *)p, max_size, randomflg);
+   mp->path = strdup(path);
+   return 0;
+}
+
+/*
+ *  init_memphy_image - init MEMPHY struct over a section of a host file
+ *  @mp: memphy struct
+ *  @max_size: device size, the file must hold the whole section
+ *  @fd: open host file, read access is enough
+ *  @off: section offset, a multiple of the host page size
+ *
+ *  The section is mapped private: a frame is read from the file when
+ *  first touched and the writes stay with the simulation
+ */
+int init_memphy_image(struct memphy_struct *mp, addr_t max_size, int randomflg,
+                      int fd, addr_t off)
+{
+   void *p;
+
+   if (max_size == 0) return init_memphy(mp, max_size, randomflg);
+
+   p = mmap(NULL, max_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_NORESERVE, fd, off);
+   if (p == MAP_FAILED) return -1;
+
+   return MEMPHY_setup(mp, (BYTE *)p, max_size, randomflg);
+}
+
+/*
+ *  free_memphy - release MEMPHY storage and frame lists
+ *  @mp: memphy struct
+ */
+int free_memphy(struct memphy_struct *mp)
+{
+   if (mp == NULL) return -1;
+
+   /* The frame lists live in the block of the descriptors */
+   free(mp->fdesc);
+   mp->fdesc = NULL;
+   mp->free_fp_stack = NULL;
+   mp->free_fp_pos = NULL;
+   mp->free_fp_map = NULL;
+   mp->free_fp_top = mp->numfp = 0;
+
+   if (mp->storage != NULL)
+      munmap(mp->storage, mp->maxsz);
+   mp->storage = NULL;
+   free(mp->path);
+   mp->path = NULL;
+   mp->maxsz = 0;
 
    return 0;
 }
@@ -0,0 +1,386 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+/*
+ * PAGING based Memory Management
+ * Page replacement policies mm/mm-policy.c
+ *
+ * The resident pages of an mm sit on page lists linked through the
+ * descriptors of their frames. A policy decides which list a page
+ * enters and which page leaves when a frame is needed:
+ *  fifo  - oldest page first
+ *  clock - second chance, a page used since the last pass goes round
+ *  lru   - aging counters fed by the accessed bit, lowest age first
+ *  arc   - adaptive replacement between recency (T1) and frequency
+ *          (T2), tuned by the ghost lists B1 and B2
+ * The accessed bit is only set by a page walk, so clearing it shoots
+ * the TLB entry down to make the next use walk again. ARC sees a hit
+ * the same way: a T1 page found accessed at replacement time moves
+ * to T2, as in CAR.
+ * All of it runs under the mmvm_lock, which guards the lists, and the
+ * lock of the mm, which guards the PTEs; see select_victim_mm.
+ *
+ * The 32-bit paging has no frame descriptors, it keeps its own FIFO
+ * in mm->fifo_pgn and only knows the fifo name.
+ */
+
+#include "mm.h"
+#include "mm64.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(MM64)
+
+#define MM_AGE_MSB (1U << (MM_AGE_BITS - 1))
+#define ARC_HASH(pgn) ((pgn) % MM_ARC_HASH_SZ)
+#define ARC_MAX(a, b) (((a) > (b)) ? (a) : (b))
+#define ARC_MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+/*
+ * pglist_push - put a page at the head of a page list
+ * @mm   : owner
+ * @list : list of the owner
+ * @pgn  : page number
+ * @fpn  : frame of the page, its descriptor is the node
+ *
+ * A frame still listed elsewhere is taken off first
+ */
+void pglist_push(struct mm_struct *mm, int list, addr_t pgn, addr_t fpn)
+{
+  struct framedesc_t *fdesc = mm->frm_mp->fdesc;
+  struct pglist_t *pl = &mm->pglist[list];
+  struct framedesc_t *fd = &fdesc[fpn];
+
+  if (fd->owner != NULL)
+    pglist_unlink(fd->owner, fpn);
+
+  fd->owner = mm;
+  fd->pgn = pgn;
+  fd->list = list;
+  fd->prev = FRAME_NIL;
+  fd->next = pl->head;
+  if (pl->head != FRAME_NIL)
+    fdesc[pl->head].prev = fpn;
+  else
+    pl->tail = fpn;
+  pl->head = fpn;
+  pl->nr++;
+}
+
+/*
+ * pglist_unlink - take a frame off the page list holding it
+ */
+void pglist_unlink(struct mm_struct *mm, addr_t fpn)
+{
+  struct framedesc_t *fdesc = mm->frm_mp->fdesc;
+  struct framedesc_t *fd = &fdesc[fpn];
+  struct pglist_t *pl = &mm->pglist[fd->list];
+
+  if (fd->prev != FRAME_NIL)
+    fdesc[fd->prev].next = fd->next;
+  else
+    pl->head = fd->next;
+  if (fd->next != FRAME_NIL)
+    fdesc[fd->next].prev = fd->prev;
+  else
+    pl->tail = fd->prev;
+
+  fd->owner = NULL;
+  fd->prev = fd->next = FRAME_NIL;
+  pl->nr--;
+}
+
+/*
+ * pg_young - test and clear the accessed bit of a resident page
+ * Return 1 if the page was used since the last test
+ */
+static int pg_young(struct krnl_t *krnl, struct mm_struct *mm, addr_t pgn)
+{
+  if (!(pgtbl_load(mm, pgn) & PAGING_PTE_ACCESSED_MASK))
+    return 0;
+
+  pgtbl_update(mm, pgn, 0, PAGING_PTE_ACCESSED_MASK);
+  tlb_shootdown(krnl, mm->asid, pgn);
+  return 1;
+}
+
+/* Take the tail of a list as the victim */
+static int pglist_pop(struct mm_struct *mm, int list, addr_t *pgn)
+{
+  addr_t fpn = mm->pglist[list].tail;
+
+  if (fpn == FRAME_NIL)
+    return -1;
+
+  *pgn = mm->frm_mp->fdesc[fpn].pgn;
+  pglist_unlink(mm, fpn);
+  return 0;
+}
+
+/*
+ * FIFO
+ */
+static void fifo_insert(struct mm_struct *mm, addr_t pgn, addr_t fpn)
+{
+  pglist_push(mm, 0, pgn, fpn);
+}
+
+static void fifo_remove(struct mm_struct *mm, addr_t fpn)
+{
+  pglist_unlink(mm, fpn);
+}
+
+static int fifo_victim(struct krnl_t *krnl, struct mm_struct *mm, addr_t *pgn)
+{
+  return pglist_pop(mm, 0, pgn);
+}
+
+static void fifo_release(struct mm_struct *mm)
+{
+}
+
+/*
+ * CLOCK, the list is the clock face with the hand at the tail. A
+ * used page loses its bit and goes behind the hand
+ */
+static int clock_victim(struct krnl_t *krnl, struct mm_struct *mm, addr_t *pgn)
+{
+  struct framedesc_t *fdesc = mm->frm_mp->fdesc;
+  addr_t fpn;
+
+  while ((fpn = mm->pglist[0].tail) != FRAME_NIL &&
+         pg_young(krnl, mm, fdesc[fpn].pgn))
+  {
+    pglist_unlink(mm, fpn);
+    pglist_push(mm, 0, fdesc[fpn].pgn, fpn);
+  }
+
+  return pglist_pop(mm, 0, pgn);
+}
+
+/*
+ * LRU approximation by aging. Each pass shifts the counters right
+ * and feeds the accessed bit in at the top, the lowest count is the
+ * least recently used. Ties go to the older page
+ */
+static void lru_insert(struct mm_struct *mm, addr_t pgn, addr_t fpn)
+{
+  pglist_push(mm, 0, pgn, fpn);
+  mm->frm_mp->fdesc[fpn].age = MM_AGE_MSB;
+}
+
+static int lru_victim(struct krnl_t *krnl, struct mm_struct *mm, addr_t *pgn)
+{
+  struct framedesc_t *fdesc = mm->frm_mp->fdesc;
+  addr_t fpn, vic = FRAME_NIL;
+
+  for (fpn = mm->pglist[0].tail; fpn != FRAME_NIL; fpn = fdesc[fpn].prev)
+  {
+    struct framedesc_t *fd = &fdesc[fpn];
+
+    fd->age >>= 1;
+    if (pg_young(krnl, mm, fd->pgn))
+      fd->age |= MM_AGE_MSB;
+    if (vic == FRAME_NIL || fd->age < fdesc[vic].age)
+      vic = fpn;
+  }
+
+  if (vic == FRAME_NIL)
+    return -1;
+
+  *pgn = fdesc[vic].pgn;
+  pglist_unlink(mm, vic);
+  return 0;
+}
+
+/*
+ * ARC ghost lists
+ */
+static struct arc_ghost_t *arc_ghost_find(struct arc_t *arc, addr_t pgn)
+{
+  struct arc_ghost_t *g;
+
+  for (g = arc->hash[ARC_HASH(pgn)]; g != NULL; g = g->hnext)
+    if (g->pgn == pgn)
+      return g;
+  return NULL;
+}
+
+static void arc_ghost_del(struct arc_t *arc, struct arc_ghost_t *g)
+{
+  struct arc_ghost_t **pp = &arc->hash[ARC_HASH(g->pgn)];
+
+  while (*pp != g)
+    pp = &(*pp)->hnext;
+  *pp = g->hnext;
+
+  if (g->prev != NULL)
+    g->prev->next = g->next;
+  else
+    arc->head[g->list] = g->next;
+  if (g->next != NULL)
+    g->next->prev = g->prev;
+  else
+    arc->tail[g->list] = g->prev;
+
+  arc->nr[g->list]--;
+  free(g);
+}
+
+/*
+ * arc_ghost_push - remember an evicted page at the head of B1 or B2
+ * @arc  : ARC state
+ * @list : 0 for B1, 1 for B2
+ * @pgn  : page number
+ */
+int arc_ghost_push(struct arc_t *arc, int list, addr_t pgn)
+{
+  struct arc_ghost_t *g = malloc(sizeof(struct arc_ghost_t));
+
+  if (g == NULL)
+    return -1;
+
+  g->pgn = pgn;
+  g->list = list;
+  g->prev = NULL;
+  g->next = arc->head[list];
+  if (arc->head[list] != NULL)
+    arc->head[list]->prev = g;
+  else
+    arc->tail[list] = g;
+  arc->head[list] = g;
+  g->hnext = arc->hash[ARC_HASH(pgn)];
+  arc->hash[ARC_HASH(pgn)] = g;
+  arc->nr[list]++;
+  return 0;
+}
+
+/*
+ * arc_get - ARC state of an mm, made on first use
+ */
+struct arc_t *arc_get(struct mm_struct *mm)
+{
+  if (mm->arc == NULL)
+    mm->arc = calloc(1, sizeof(struct arc_t));
+  return mm->arc;
+}
+
+/*
+ * ARC, the cache size c is the number of RAM frames. A miss found in
+ * a ghost list moves the target p toward the list it came from
+ */
+static void arc_insert(struct mm_struct *mm, addr_t pgn, addr_t fpn)
+{
+  struct arc_t *arc = arc_get(mm);
+  struct arc_ghost_t *g = (arc != NULL) ? arc_ghost_find(arc, pgn) : NULL;
+  addr_t c = mm->frm_mp->numfp;
+
+  if (arc == NULL) {
+    pglist_push(mm, 0, pgn, fpn);
+    return;
+  }
+
+  if (g != NULL && g->list == 0)
+    arc->p = ARC_MIN(c, arc->p + ARC_MAX(arc->nr[1] / arc->nr[0], 1));
+  else if (g != NULL)
+    arc->p -= ARC_MIN(arc->p, ARC_MAX(arc->nr[0] / arc->nr[1], 1));
+
+  if (g != NULL) {
+    arc_ghost_del(arc, g);
+    pglist_push(mm, 1, pgn, fpn);
+  } else {
+    pglist_push(mm, 0, pgn, fpn);
+  }
+
+  /* Keep T1 + B1 within c and the whole directory within 2c */
+  while (arc->nr[0] > 0 && mm->pglist[0].nr + arc->nr[0] > c)
+    arc_ghost_del(arc, arc->tail[0]);
+  while (arc->nr[1] > 0 && mm->pglist[0].nr + mm->pglist[1].nr +
+                           arc->nr[0] + arc->nr[1] > 2 * c)
+    arc_ghost_del(arc, arc->tail[1]);
+}
+
+static int arc_victim(struct krnl_t *krnl, struct mm_struct *mm, addr_t *pgn)
+{
+  struct framedesc_t *fdesc = mm->frm_mp->fdesc;
+  struct arc_t *arc = arc_get(mm);
+  addr_t p = (arc != NULL) ? arc->p : 0;
+  addr_t fpn;
+  int list;
+
+  while (mm->pglist[0].nr + mm->pglist[1].nr > 0)
+  {
+    list = (mm->pglist[0].nr > 0 &&
+            (mm->pglist[0].nr >= ARC_MAX(p, 1) || mm->pglist[1].nr == 0))
+           ? 0 : 1;
+    fpn = mm->pglist[list].tail;
+
+    /* Used again since it came in, it belongs to the frequent side */
+    if (pg_young(krnl, mm, fdesc[fpn].pgn))
+    {
+      pglist_unlink(mm, fpn);
+      pglist_push(mm, 1, fdesc[fpn].pgn, fpn);
+      continue;
+    }
+
+    *pgn = fdesc[fpn].pgn;
+    pglist_unlink(mm, fpn);
+    if (arc != NULL)
+      arc_ghost_push(arc, list, *pgn);
+    return 0;
+  }
+
+  return -1;
+}
+
+static void arc_release(struct mm_struct *mm)
+{
+  struct arc_t *arc = mm->arc;
+  int list;
+
+  if (arc == NULL)
+    return;
+
+  for (list = 0; list < 2; list++)
+    while (arc->head[list] != NULL)
+      arc_ghost_del(arc, arc->head[list]);
+  free(arc);
+  mm->arc = NULL;
+}
+
+static const struct mm_policy_t mm_policies[] = {
+  { "fifo",  fifo_insert, fifo_remove, fifo_victim,  fifo_release },
+  { "clock", fifo_insert, fifo_remove, clock_victim, fifo_release },
+  { "lru",   lru_insert,  fifo_remove, lru_victim,   fifo_release },
+  { "arc",   arc_insert,  fifo_remove, arc_victim,   arc_release },
+};
+#else
+static const struct mm_policy_t mm_policies[] = {
+  { "fifo",  NULL,        NULL,        NULL,         NULL },
+};
+#endif  //def MM64
+
+/*
+ * mm_policy_get - find a replacement policy by name
+ * @name : policy name, NULL for the default FIFO
+ * Return NULL if there is no such policy
+ */
+const struct mm_policy_t *mm_policy_get(const char *name)
+{
+  size_t i;
+
+  if (name == NULL)
+    return &mm_policies[0];
+
+  for (i = 0; i < sizeof(mm_policies) / sizeof(mm_policies[0]); i++)
+    if (strcmp(mm_policies[i].name, name) == 0)
+      return &mm_policies[i];
+  return NULL;
+}
@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+/*
+ * PAGING based Memory Management
+ * Shared memory segments mm/mm-shm.c
+ *
+ * A segment is a set of RAM frames taken when it is created, found
+ * again by its key. Attaching it maps all of its frames, writable, at
+ * a page aligned region grown at the end of the data area of the
+ * caller, so every attached address space sees the writes of the
+ * others. Each mapping is counted on the segment. The frames are on
+ * no page list: no replacement policy picks them, reclaim and KSM
+ * leave them alone, and an exiting process only drops its mappings.
+ * A forked child inherits the attachments of its parent. Once the
+ * last mapping goes, by a detach or an exit, the frames go back to
+ * RAM and the key is free again; a segment never attached stays.
+ *
+ * The segment table is guarded by the mmvm_lock, the mappings of an
+ * address space by its mm lock, taken first.
+ */
+
+#include "mm.h"
+#include "mm64.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+#if defined(MM64)
+
+static int shm_attach_add(struct shm_seg_t *seg, struct mm_struct *mm,
+                          addr_t pgn)
+{
+  struct shm_attach_t *at = malloc(sizeof(struct shm_attach_t));
+
+  if (at == NULL)
+    return -1;
+  at->mm = mm;
+  at->pgn = pgn;
+  at->next = seg->attach;
+  seg->attach = at;
+  seg->nattch++;
+  return 0;
+}
+
+/* The last mapping of a segment went, give its frames back */
+static void shm_release(struct krnl_t *krnl, struct shm_seg_t *seg)
+{
+  struct memphy_struct *mram = krnl->mram;
+  addr_t i;
+
+  for (i = 0; i < seg->npages; i++)
+  {
+    mram->fdesc[seg->fpn[i]].shm = 0;
+    MEMPHY_put_freefp(mram, seg->fpn[i]);
+  }
+  free(seg->fpn);
+  seg->fpn = NULL;
+  seg->key = 0;
+  seg->npages = 0;
+}
+
+/*
+ * shm_get - find the segment of a key, or create it
+ * @krnl:   kernel
+ * @caller: process the frames are reclaimed for, if RAM is short
+ * @key:    key of the segment, 0 always creates a new one
+ * @size:   bytes, an existing segment must hold at least as many
+ * @id:     return segment id
+ *
+ * A new segment gets cleared frames. The segments together may hold
+ * MM_SHM_PCT percent of the RAM frames
+ */
+int shm_get(struct krnl_t *krnl, struct pcb_t *caller, uint32_t key,
+            addr_t size, int *id)
+{
+  struct memphy_struct *mram = krnl->mram;
+  addr_t npages = DIV_ROUND_UP(size, PAGING64_PAGESZ);
+  addr_t used = 0, i;
+  struct shm_seg_t *seg = NULL;
+  int ret = -1, sid;
+
+  pthread_mutex_lock(&krnl->mmvm_lock);
+  for (sid = 0; sid < MM_SHM_MAX; sid++)
+  {
+    if (key == 0 || krnl->shm[sid].fpn == NULL || krnl->shm[sid].key != key)
+      continue;
+    if (npages <= krnl->shm[sid].npages)
+    {
+      *id = sid;
+      ret = 0;
+    }
+    goto out;
+  }
+
+  for (sid = MM_SHM_MAX - 1; sid >= 0; sid--)
+  {
+    if (krnl->shm[sid].fpn == NULL)
+      seg = &krnl->shm[sid];
+    else
+      used += krnl->shm[sid].npages;
+  }
+  if (seg == NULL || npages == 0 ||
+      used + npages > mram->numfp * MM_SHM_PCT / 100)
+    goto out;
+  sid = seg - krnl->shm;
+
+  seg->fpn = malloc(npages * sizeof(addr_t));
+  if (seg->fpn == NULL)
+    goto out;
+  for (i = 0; i < npages; i++)
+  {
+    if (pg_getframe(caller, &seg->fpn[i]) != 0)
+    {
+      while (i-- > 0)
+      {
+        mram->fdesc[seg->fpn[i]].shm = 0;
+        MEMPHY_put_freefp(mram, seg->fpn[i]);
+      }
+      free(seg->fpn);
+      seg->fpn = NULL;
+      goto out;
+    }
+    MEMPHY_clear_frames(mram, seg->fpn[i], 1, PAGING64_PAGESZ);
+    mram->fdesc[seg->fpn[i]].shm = sid + 1;
+  }
+  seg->key = key;
+  seg->npages = npages;
+  seg->nattch = 0;
+  seg->attach = NULL;
+  *id = sid;
+  ret = 0;
+
+out:
+  pthread_mutex_unlock(&krnl->mmvm_lock);
+  return ret;
+}
+
+/*
+ * shm_attach - map a segment into the address space of the caller
+ * @krnl:   kernel
+ * @caller: caller
+ * @id:     segment id
+ * @rgid:   memory region ID the mapping is known by
+ *
+ * The region starts on the first page boundary past the break of the
+ * data area and covers whole pages
+ */
+int shm_attach(struct krnl_t *krnl, struct pcb_t *caller, int id, int rgid)
+{
+  struct mm_struct *mm = caller->mm;
+  struct vm_area_struct *vma;
+  struct shm_seg_t *seg;
+  addr_t start, sbrk;
+  int ret = -1;
+
+  if (id < 0 || id >= MM_SHM_MAX || rgid < 0 || rgid >= PAGING_MAX_SYMTBL_SZ)
+    return -1;
+
+  pthread_mutex_lock(&mm->lock);
+  pthread_mutex_lock(&krnl->mmvm_lock);
+  seg = &krnl->shm[id];
+  vma = get_vma_by_num(mm, 0);
+  if (seg->fpn == NULL || vma == NULL)
+    goto out;
+
+  sbrk = vma->sbrk;
+  start = PAGING64_PAGE_ALIGNSZ(sbrk);
+  if (inc_vma_limit(caller, 0, start - sbrk + seg->npages * PAGING64_PAGESZ) != 0)
+    goto out;
+  if (map_range(caller, start >> PAGING64_ADDR_PT_SHIFT, seg->npages, seg->fpn) != 0 ||
+      shm_attach_add(seg, mm, start >> PAGING64_ADDR_PT_SHIFT) != 0)
+  {
+    unmap_range(caller, start >> PAGING64_ADDR_PT_SHIFT, seg->npages);
+    goto out;
+  }
+
+  mm->symrgtbl[rgid].rg_start = start;
+  mm->symrgtbl[rgid].rg_end = start + seg->npages * PAGING64_PAGESZ;
+  ret = 0;
+
+out:
+  pthread_mutex_unlock(&krnl->mmvm_lock);
+  pthread_mutex_unlock(&mm->lock);
+  return ret;
+}
+
+/*
+ * shm_detach - unmap the segment attached at a region of the caller
+ * @krnl:   kernel
+ * @caller: caller
+ * @rgid:   memory region ID given to shm_attach
+ *
+ * The region is freed as by __free, its pages fault anew if used.
+ * The segment goes with its last mapping
+ */
+int shm_detach(struct krnl_t *krnl, struct pcb_t *caller, int rgid)
+{
+  struct mm_struct *mm = caller->mm;
+  struct vm_rg_struct *rg;
+  struct shm_attach_t **pp, *at;
+  addr_t pgn;
+  int sid;
+
+  if (rgid < 0 || rgid >= PAGING_MAX_SYMTBL_SZ)
+    return -1;
+
+  pthread_mutex_lock(&mm->lock);
+  rg = &mm->symrgtbl[rgid];
+  pgn = rg->rg_start >> PAGING64_ADDR_PT_SHIFT;
+  pthread_mutex_lock(&krnl->mmvm_lock);
+  for (sid = 0; rg->rg_start != rg->rg_end && sid < MM_SHM_MAX; sid++)
+  {
+    struct shm_seg_t *seg = &krnl->shm[sid];
+    for (pp = &seg->attach; (at = *pp) != NULL; pp = &at->next)
+    {
+      if (at->mm != mm || at->pgn != pgn)
+        continue;
+      unmap_range(caller, pgn, seg->npages);
+      *pp = at->next;
+      free(at);
+      if (--seg->nattch == 0)
+        shm_release(krnl, seg);
+      pthread_mutex_unlock(&krnl->mmvm_lock);
+
+      enlist_vm_freerg_list(mm, init_vm_rg(rg->rg_start, rg->rg_end));
+      rg->rg_start = rg->rg_end = 0;
+      pthread_mutex_unlock(&mm->lock);
+      return 0;
+    }
+  }
+  pthread_mutex_unlock(&krnl->mmvm_lock);
+  pthread_mutex_unlock(&mm->lock);
+  return -1;
+}
+
+/*
+ * shm_detach_mm - drop every mapping of an address space that goes
+ *
+ * Runs under the mm lock and the mmvm_lock once the pages of mm are
+ * freed, which leaves the segment frames alone. A segment left with
+ * no mapping goes
+ */
+void shm_detach_mm(struct krnl_t *krnl, struct mm_struct *mm)
+{
+  struct shm_attach_t **pp, *at;
+  struct shm_seg_t *seg;
+  int sid;
+
+  if (krnl->shm == NULL)
+    return;
+  for (sid = 0; sid < MM_SHM_MAX; sid++)
+  {
+    seg = &krnl->shm[sid];
+    if (seg->attach == NULL)
+      continue;
+    pp = &seg->attach;
+    while ((at = *pp) != NULL)
+    {
+      if (at->mm != mm)
+      {
+        pp = &at->next;
+        continue;
+      }
+      *pp = at->next;
+      free(at);
+      seg->nattch--;
+    }
+    if (seg->nattch == 0)
+      shm_release(krnl, seg);
+  }
+}
+
+/*
+ * shm_dup - give a copy of an address space the mappings of src
+ *
+ * The PTEs themselves are copied by dup_mm. Runs under the mmvm_lock
+ * and the mm locks of both
+ */
+int shm_dup(struct krnl_t *krnl, struct mm_struct *mm, struct mm_struct *src)
+{
+  struct shm_attach_t *at;
+  int sid;
+
+  if (krnl->shm == NULL)
+    return 0;
+  for (sid = 0; sid < MM_SHM_MAX; sid++)
+    for (at = krnl->shm[sid].attach; at != NULL; at = at->next)
+      if (at->mm == src && shm_attach_add(&krnl->shm[sid], mm, at->pgn) != 0)
+        return -1;
+  return 0;
+}
+
+/*
+ * shm_destroy - free the segment table, the frames go with the RAM
+ */
+void shm_destroy(struct shm_seg_t *shm)
+{
+  struct shm_attach_t *at;
+  int sid;
+
+  for (sid = 0; sid < MM_SHM_MAX; sid++)
+  {
+    while ((at = shm[sid].attach) != NULL)
+    {
+      shm[sid].attach = at->next;
+      free(at);
+    }
+    free(shm[sid].fpn);
+    shm[sid].fpn = NULL;
+  }
+}
+
+#endif  //def MM64
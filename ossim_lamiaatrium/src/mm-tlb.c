@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+/*
+ * PAGING based Memory Management
+ * Per CPU software TLB mm/mm-tlb.c
+ *
+ * Every CPU owns a small set associative cache of PGN -> FPN
+ * translations in front of the page table walk. Entries carry the
+ * ASID of their mm, so a context switch keeps them; a PTE update
+ * shoots the matching entry down on every CPU. Entries of an mm are
+ * filled and shot down under the lock of that mm, like the page table
+ * they mirror. A CPU fills its TLB while other threads shoot entries
+ * of other mm down, the lock of each TLB keeps its sets whole.
+ */
+
+#include "mm.h"
+#include "mm64.h"
+#include <pthread.h>
+
+#define TLB_SET(pgn) ((pgn) & (MM_TLB_SETS - 1))
+#define TLB_HUGE_BASE(pgn) ((pgn) & ~(addr_t)(PAGING64_HUGE_PGNUM - 1))
+#define TLB_HUGE_SET(pgn) TLB_SET((pgn) / PAGING64_HUGE_PGNUM)
+
+static struct tlb_entry_t *tlb_find(struct tlb_t *tlb, uint32_t asid,
+                                    addr_t pgn, int huge)
+{
+  struct tlb_entry_t *set;
+  addr_t tag = huge ? TLB_HUGE_BASE(pgn) : pgn;
+  int way;
+
+  set = tlb->ent[huge ? TLB_HUGE_SET(pgn) : TLB_SET(pgn)];
+  for (way = 0; way < MM_TLB_WAYS; way++)
+    if (set[way].valid && set[way].huge == huge &&
+        set[way].asid == asid && set[way].pgn == tag)
+      return &set[way];
+  return NULL;
+}
+
+/*
+ * tlb_init - make the lock of a CPU TLB, its entries start zeroed
+ * tlb_destroy - free it
+ */
+void tlb_init(struct tlb_t *tlb)
+{
+  pthread_mutex_init(&tlb->lock, NULL);
+}
+
+void tlb_destroy(struct tlb_t *tlb)
+{
+  pthread_mutex_destroy(&tlb->lock);
+}
+
+/*
+ * tlb_lookup - translate a page through the TLB
+ * @tlb  : TLB of the running CPU, may be NULL
+ * @asid : address space of the page
+ * @pgn  : page number
+ * @write: the access is a write
+ * @fpn  : receives the frame on a hit
+ * Return 0 on a hit, -1 on a miss. A write through a clean entry
+ * misses, so the walk can mark the PTE dirty
+ */
+int tlb_lookup(struct tlb_t *tlb, uint32_t asid, addr_t pgn, int write, addr_t *fpn)
+{
+  struct tlb_entry_t *e;
+
+  if (tlb == NULL)
+    return -1;
+
+  pthread_mutex_lock(&tlb->lock);
+  if ((e = tlb_find(tlb, asid, pgn, 0)) == NULL)
+    e = tlb_find(tlb, asid, pgn, 1);
+  if (e == NULL || (write && !e->dirty)) {
+    tlb->misses++;
+    pthread_mutex_unlock(&tlb->lock);
+    return -1;
+  }
+  *fpn = e->fpn + (pgn - e->pgn);
+  tlb->hits++;
+  pthread_mutex_unlock(&tlb->lock);
+  return 0;
+}
+
+/*
+ * tlb_fill - cache a translation found by a walk
+ * @tlb  : TLB of the running CPU, may be NULL
+ * @asid : address space of the page
+ * @pgn  : page number
+ * @fpn  : frame the page is mapped to
+ * @huge : the page belongs to a huge mapping, cache all of it
+ * @dirty: the PTE is dirty, writes may hit
+ */
+void tlb_fill(struct tlb_t *tlb, uint32_t asid, addr_t pgn, addr_t fpn,
+              int huge, int dirty)
+{
+  struct tlb_entry_t *set, *e = NULL;
+  int way, s;
+
+  if (tlb == NULL)
+    return;
+
+  if (huge) {
+    fpn -= pgn - TLB_HUGE_BASE(pgn);
+    pgn = TLB_HUGE_BASE(pgn);
+    s = TLB_HUGE_SET(pgn);
+  } else {
+    s = TLB_SET(pgn);
+  }
+  pthread_mutex_lock(&tlb->lock);
+  set = tlb->ent[s];
+  e = tlb_find(tlb, asid, pgn, huge != 0);
+  for (way = 0; way < MM_TLB_WAYS && e == NULL; way++)
+    if (!set[way].valid)
+      e = &set[way];
+
+  if (e == NULL)
+  {
+    e = &set[tlb->next[s]];
+    tlb->next[s] = (tlb->next[s] + 1) % MM_TLB_WAYS;
+  }
+
+  e->asid = asid;
+  e->pgn = pgn;
+  e->fpn = fpn;
+  e->huge = (huge != 0);
+  e->dirty = (dirty != 0);
+  e->valid = 1;
+  pthread_mutex_unlock(&tlb->lock);
+}
+
+/*
+ * tlb_shootdown - drop one translation from the TLB of every CPU
+ * @krnl : kernel owning the CPUs
+ * @asid : address space of the page
+ * @pgn  : page number whose PTE changed
+ *
+ * A huge entry covering the page goes too, its mapping is being split
+ */
+void tlb_shootdown(struct krnl_t *krnl, uint32_t asid, addr_t pgn)
+{
+  struct tlb_entry_t *e;
+  int i, huge;
+
+  if (krnl->cpus == NULL)
+    return;
+
+  for (i = 0; i < krnl->num_cpus; i++)
+  {
+    struct tlb_t *tlb = &krnl->cpus[i].tlb;
+
+    pthread_mutex_lock(&tlb->lock);
+    for (huge = 0; huge <= 1; huge++)
+    {
+      if ((e = tlb_find(tlb, asid, pgn, huge)) != NULL)
+      {
+        e->valid = 0;
+        tlb->shootdowns++;
+      }
+    }
+    pthread_mutex_unlock(&tlb->lock);
+  }
+}
+
+/*
+ * tlb_flush_asid - drop every translation of an address space
+ * @krnl : kernel owning the CPUs
+ * @asid : address space going away
+ */
+void tlb_flush_asid(struct krnl_t *krnl, uint32_t asid)
+{
+  int i, s, way;
+
+  if (krnl->cpus == NULL)
+    return;
+
+  for (i = 0; i < krnl->num_cpus; i++)
+  {
+    struct tlb_t *tlb = &krnl->cpus[i].tlb;
+
+    pthread_mutex_lock(&tlb->lock);
+    for (s = 0; s < MM_TLB_SETS; s++)
+      for (way = 0; way < MM_TLB_WAYS; way++)
+        if (tlb->ent[s][way].asid == asid)
+          tlb->ent[s][way].valid = 0;
+    pthread_mutex_unlock(&tlb->lock);
+  }
+}
@@ -49,10 +49,42 @@ struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid)
   return pvma;
 }
 
-int __mm_swap_page(struct pcb_t *caller, addr_t vicfpn , addr_t swpfpn)
+/*get_vma_by_addr - get the vm area holding an address
+ *@mm: memory region
+ *@addr: virtual address, below the sbrk of its area
+ *
+ */
+struct vm_area_struct *get_vma_by_addr(struct mm_struct *mm, addr_t addr)
+{
+  struct vm_area_struct *pvma;
+
+  for (pvma = mm->mmap; pvma != NULL; pvma = pvma->vm_next)
+    if (addr >= pvma->vm_start && addr < pvma->sbrk)
+      return pvma;
+
+  return NULL;
+}
+
+/*__mm_swap_page - swap out a RAM frame
+ *@vicfpn: victim frame in RAM
+ *@swptyp: swap device
+ *@swpfpn: destination frame in the swap device
+ */
+int __mm_swap_page(struct pcb_t *caller, addr_t vicfpn, int swptyp, addr_t swpfpn)
+{
+    if (swptyp < 0 || swptyp >= PAGING_MAX_MMSWP) return -1;
+    return __swap_cp_page(caller->krnl->mram, vicfpn, &caller->krnl->mswp[swptyp], swpfpn);
+}
+
+/*__mm_swap_in_page - swap in a frame of a swap device
+ *@swptyp: swap device
+ *@swpfpn: source frame in the swap device
+ *@tgtfpn: destination frame in RAM
+ */
+int __mm_swap_in_page(struct pcb_t *caller, int swptyp, addr_t swpfpn, addr_t tgtfpn)
 {
-    __swap_cp_page(caller->krnl->mram, vicfpn, caller->krnl->active_mswp, swpfpn);
-    return 0;
+    if (swptyp < 0 || swptyp >= PAGING_MAX_MMSWP) return -1;
+    return __swap_cp_page(&caller->krnl->mswp[swptyp], swpfpn, caller->krnl->mram, tgtfpn);
 }
 
 /*get_vm_area_node - get vm area for a number of pages
@@ -160,6 +192,11 @@ int inc_vma_limit(struct pcb_t *caller, int vmaid, addr_t inc_sz)
     return -1;
   }
 
+#ifdef MM64
+  /* Only the virtual space is reserved, pg_getpage gives each page
+   * a frame on its first touch */
+  (void)incnumpage;
+#else
   struct vm_rg_struct newrg;
   newrg.rg_start = old_sbrk;
   newrg.rg_end = new_end;
@@ -174,6 +211,7 @@ int inc_vma_limit(struct pcb_t *caller, int vmaid, addr_t inc_sz)
     cur_vma->sbrk = old_sbrk;
     return -1;
   }
+#endif
 
   return 0;
 }
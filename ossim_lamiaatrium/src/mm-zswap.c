@@ -0,0 +1,450 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+/*
+ * PAGING based Memory Management
+ * Compressed swap cache mm/mm-zswap.c
+ *
+ * A victim page is first run through a small run length codec. When
+ * it shrinks to half a page or less it is kept in the pool, a few RAM
+ * frames cut into ZSWAP_NCHUNK chunks, and never reaches a swap
+ * device. The pool grows up to MM_ZSWAP_POOL_PCT of RAM, from free RAM
+ * frames or, when none is left, from the frame of the victim itself;
+ * once full, the least recently stored pages are decompressed onto a
+ * swap device to make room. All of it runs under the mmvm_lock, a
+ * PTE written back is changed under the lock of its mm too.
+ */
+
+#include "mm.h"
+#include "mm64.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(MM64)
+
+#define ZSWAP_CHUNKSZ (PAGING64_PAGESZ / ZSWAP_NCHUNK)
+#define ZSWAP_MAXSZ (PAGING64_PAGESZ / 2)   /* worse than 2:1 is rejected */
+#define ZSWAP_WRITEBACK_TRIES 4
+
+/*
+ * Run length codec. A control byte below 0x80 is followed by that
+ * many plus one literal bytes, one at or above it by a single byte
+ * repeated (ctl & 0x7f) + 3 times
+ */
+static int zswap_compress(const BYTE *src, addr_t n, BYTE *dst, addr_t max)
+{
+  addr_t i = 0, o = 0, r, l;
+
+  while (i < n)
+  {
+    for (r = 1; i + r < n && r < 130 && src[i + r] == src[i]; r++)
+      ;
+    if (r >= 3)
+    {
+      if (o + 2 > max) return -1;
+      dst[o++] = 0x80 | (r - 3);
+      dst[o++] = src[i];
+      i += r;
+      continue;
+    }
+
+    for (l = 0; i + l < n && l < 128; l++)
+      if (i + l + 2 < n && src[i + l] == src[i + l + 1] &&
+          src[i + l] == src[i + l + 2])
+        break;
+    if (o + 1 + l > max) return -1;
+    dst[o++] = l - 1;
+    memcpy(dst + o, src + i, l);
+    o += l;
+    i += l;
+  }
+  return o;
+}
+
+static int zswap_decompress(const BYTE *src, addr_t len, BYTE *dst, addr_t n)
+{
+  addr_t i = 0, o = 0, cnt;
+
+  while (i < len)
+  {
+    BYTE ctl = src[i++];
+    if (ctl & 0x80)
+    {
+      cnt = (ctl & 0x7f) + 3;
+      if (i >= len || o + cnt > n) return -1;
+      memset(dst + o, src[i++], cnt);
+    }
+    else
+    {
+      cnt = ctl + 1;
+      if (i + cnt > len || o + cnt > n) return -1;
+      memcpy(dst + o, src + i, cnt);
+      i += cnt;
+    }
+    o += cnt;
+  }
+  return (o == n) ? 0 : -1;
+}
+
+/*
+ * zswap_init - empty cache for a RAM of numfp frames
+ */
+int zswap_init(struct zswap_t *zs, addr_t numfp)
+{
+  memset(zs, 0, sizeof(struct zswap_t));
+  zs->maxpool = numfp * MM_ZSWAP_POOL_PCT / 100;
+  zs->nent = zs->maxpool * ZSWAP_NCHUNK;
+  zs->pool = calloc(zs->maxpool + 1, sizeof(addr_t));
+  zs->map = calloc(zs->maxpool + 1, sizeof(uint32_t));
+  zs->ent = calloc(zs->nent + 1, sizeof(struct zswap_entry_t));
+  if (zs->pool == NULL || zs->map == NULL || zs->ent == NULL)
+    return -1;
+  zs->lru_head = zs->lru_tail = FRAME_NIL;
+  zswap_relink(zs);
+  return 0;
+}
+
+void zswap_destroy(struct zswap_t *zs)
+{
+  free(zs->pool);
+  free(zs->map);
+  free(zs->ent);
+  zs->pool = NULL;
+  zs->map = NULL;
+  zs->ent = NULL;
+  zs->npool = zs->nent = 0;
+}
+
+/*
+ * zswap_relink - chain the unused entries again, after the used ones
+ * were filled in directly by a snapshot restore
+ */
+void zswap_relink(struct zswap_t *zs)
+{
+  addr_t i;
+
+  zs->free_ent = FRAME_NIL;
+  for (i = zs->nent; i-- > 0; )
+  {
+    if (zs->ent[i].owner != NULL)
+      continue;
+    zs->ent[i].next = zs->free_ent;
+    zs->free_ent = i;
+  }
+}
+
+/*
+ * zswap_lru_push - make entry idx the most recently stored one
+ */
+void zswap_lru_push(struct zswap_t *zs, addr_t idx)
+{
+  struct zswap_entry_t *e = &zs->ent[idx];
+
+  e->prev = FRAME_NIL;
+  e->next = zs->lru_head;
+  if (zs->lru_head != FRAME_NIL)
+    zs->ent[zs->lru_head].prev = idx;
+  else
+    zs->lru_tail = idx;
+  zs->lru_head = idx;
+}
+
+static addr_t zswap_pool_index(struct zswap_t *zs, addr_t fpn)
+{
+  addr_t i;
+
+  for (i = 0; i < zs->npool; i++)
+    if (zs->pool[i] == fpn)
+      return i;
+  return FRAME_NIL;
+}
+
+/*
+ * zswap_drop - give the chunks and the entry back. A pool frame left
+ * empty goes back to RAM
+ */
+static void zswap_drop(struct krnl_t *krnl, addr_t idx)
+{
+  struct zswap_t *zs = krnl->zswap;
+  struct zswap_entry_t *e = &zs->ent[idx];
+  uint32_t nchunk = (e->len + ZSWAP_CHUNKSZ - 1) / ZSWAP_CHUNKSZ;
+  addr_t p = zswap_pool_index(zs, e->fpn);
+
+  if (e->prev != FRAME_NIL)
+    zs->ent[e->prev].next = e->next;
+  else
+    zs->lru_head = e->next;
+  if (e->next != FRAME_NIL)
+    zs->ent[e->next].prev = e->prev;
+  else
+    zs->lru_tail = e->prev;
+
+  if (p != FRAME_NIL)
+  {
+    zs->map[p] &= ~(((nchunk < 32) ? (1u << nchunk) - 1 : ~0u) << e->chunk);
+    if (zs->map[p] == 0)
+    {
+      MEMPHY_put_freefp(krnl->mram, zs->pool[p]);
+      zs->npool--;
+      zs->pool[p] = zs->pool[zs->npool];
+      zs->map[p] = zs->map[zs->npool];
+    }
+  }
+
+  e->owner = NULL;
+  e->next = zs->free_ent;
+  zs->free_ent = idx;
+}
+
+/*
+ * zswap_writeback - move the coldest page of the cache to a swap
+ * device, its PTE follows under the lock of its owner. A page whose
+ * owner is busy in another thread is passed over
+ */
+static int zswap_writeback(struct krnl_t *krnl)
+{
+  struct zswap_t *zs = krnl->zswap;
+  addr_t idx = zs->lru_tail, swpfpn;
+  struct zswap_entry_t *e = NULL;
+  struct mm_struct *owner;
+  struct memphy_struct *mp;
+  int swptyp;
+
+  for (; idx != FRAME_NIL; idx = zs->ent[idx].prev)
+  {
+    if (pthread_mutex_trylock(&zs->ent[idx].owner->lock) == 0)
+    {
+      e = &zs->ent[idx];
+      break;
+    }
+  }
+  if (e == NULL)
+    return -1;
+  owner = e->owner;
+  if (swap_get_slot(krnl, owner, e->pgn, &swptyp, &swpfpn) != 0)
+  {
+    pthread_mutex_unlock(&owner->lock);
+    return -1;
+  }
+
+  mp = &krnl->mswp[swptyp];
+  MEMPHY_seq_xfer(mp, swpfpn * PAGING64_PAGESZ, PAGING64_PAGESZ);
+  zswap_decompress(krnl->mram->storage + e->fpn * PAGING64_PAGESZ +
+                   e->chunk * ZSWAP_CHUNKSZ, e->len,
+                   mp->storage + swpfpn * PAGING64_PAGESZ, PAGING64_PAGESZ);
+  pgtbl_set_swap(krnl, owner, e->pgn, swptyp, swpfpn);
+  pthread_mutex_unlock(&owner->lock);
+
+  krnl->nr_swpout++;
+  krnl->nr_swpout_dev[swptyp]++;
+  zs->nr_writeback++;
+  zswap_drop(krnl, idx);
+  return 0;
+}
+
+/* Add frame fpn to the pool, its first nchunk chunks in use */
+static void zswap_pool_add(struct zswap_t *zs, addr_t fpn, uint32_t nchunk)
+{
+  zs->pool[zs->npool] = fpn;
+  zs->map[zs->npool++] = (nchunk < 32) ? (1u << nchunk) - 1 : ~0u;
+}
+
+/*
+ * zswap_alloc - find nchunk free chunks in a row inside one pool frame,
+ * growing the pool from free RAM frames while it may
+ */
+static int zswap_alloc(struct krnl_t *krnl, uint32_t nchunk,
+                       addr_t *fpn, uint32_t *chunk)
+{
+  struct zswap_t *zs = krnl->zswap;
+  uint32_t want = (nchunk < 32) ? (1u << nchunk) - 1 : ~0u;
+  addr_t p;
+  uint32_t c;
+
+  for (p = 0; p < zs->npool; p++)
+  {
+    for (c = 0; c + nchunk <= ZSWAP_NCHUNK; c++)
+    {
+      if ((zs->map[p] & (want << c)) == 0)
+      {
+        zs->map[p] |= want << c;
+        *fpn = zs->pool[p];
+        *chunk = c;
+        return 0;
+      }
+    }
+  }
+
+  if (zs->npool < zs->maxpool && MEMPHY_get_freefp(krnl->mram, fpn) == 0)
+  {
+    zswap_pool_add(zs, *fpn, nchunk);
+    *chunk = 0;
+    return 0;
+  }
+  return -1;
+}
+
+/* Fill a free entry for len compressed bytes at chunk of pool frame
+ * pfpn, the most recently stored one */
+static addr_t zswap_insert(struct krnl_t *krnl, struct mm_struct *mm,
+                           addr_t pgn, addr_t pfpn, uint32_t chunk,
+                           const BYTE *buf, int len)
+{
+  struct zswap_t *zs = krnl->zswap;
+  addr_t idx = zs->free_ent;
+
+  zs->free_ent = zs->ent[idx].next;
+  zs->ent[idx].owner = mm;
+  zs->ent[idx].pgn = pgn;
+  zs->ent[idx].fpn = pfpn;
+  zs->ent[idx].chunk = chunk;
+  zs->ent[idx].len = len;
+  zswap_lru_push(zs, idx);
+
+  memcpy(krnl->mram->storage + pfpn * PAGING64_PAGESZ + chunk * ZSWAP_CHUNKSZ,
+         buf, len);
+  zs->nr_store++;
+  zs->bytes_stored += len;
+  return idx;
+}
+
+/*
+ * zswap_store - take a victim page into the cache
+ * @krnl: kernel
+ * @mm: owner of the page
+ * @pgn: its PGN, for a later write back
+ * @fpn: RAM frame holding it, free again on success
+ * @take: fpn may become a pool frame, no other page maps it
+ * @off: return entry index, the swap offset of the PTE
+ *
+ * With no free RAM frame to grow the pool, fpn itself is taken into
+ * it before any cold page is written back. Return 1 then, 0 when fpn
+ * is free. Return -1 when the page does not compress well enough or
+ * no room is left even after writing cold pages back, it then goes
+ * to swap
+ */
+int zswap_store(struct krnl_t *krnl, struct mm_struct *mm, addr_t pgn,
+                addr_t fpn, int take, addr_t *off)
+{
+  struct zswap_t *zs = krnl->zswap;
+  BYTE buf[ZSWAP_MAXSZ];
+  int len, tries, ret = 0;
+  uint32_t nchunk, chunk;
+  addr_t pfpn;
+
+  len = zswap_compress(krnl->mram->storage + fpn * PAGING64_PAGESZ,
+                       PAGING64_PAGESZ, buf, sizeof(buf));
+  if (len < 0)
+  {
+    zs->nr_reject++;
+    return -1;
+  }
+  nchunk = (len + ZSWAP_CHUNKSZ - 1) / ZSWAP_CHUNKSZ;
+
+  for (tries = 0; zswap_alloc(krnl, nchunk, &pfpn, &chunk) != 0; tries++)
+  {
+    if (take && zs->npool < zs->maxpool)
+    {
+      zswap_pool_add(zs, fpn, nchunk);
+      pfpn = fpn;
+      chunk = 0;
+      ret = 1;
+      break;
+    }
+    if (tries == ZSWAP_WRITEBACK_TRIES || zswap_writeback(krnl) != 0)
+    {
+      zs->nr_nomem++;
+      return -1;
+    }
+  }
+
+  *off = zswap_insert(krnl, mm, pgn, pfpn, chunk, buf, len);
+  return ret;
+}
+
+/*
+ * zswap_dup - give a page of another address space its own copy of a
+ * cached page
+ * @krnl: kernel
+ * @off: entry of the cached page
+ * @mm: address space of the copy
+ * @pgn: its page, the PTE is set here
+ *
+ * The copy stays compressed while the pool has room, without writing
+ * anything back since that could take the entry being copied. It goes
+ * to a swap device otherwise
+ */
+int zswap_dup(struct krnl_t *krnl, addr_t off, struct mm_struct *mm, addr_t pgn)
+{
+  struct zswap_t *zs = krnl->zswap;
+  struct zswap_entry_t *e;
+  uint32_t nchunk, chunk;
+  addr_t pfpn, idx, swpfpn;
+  struct memphy_struct *mp;
+  int swptyp;
+
+  if (zs == NULL || off >= zs->nent || zs->ent[off].owner == NULL)
+    return -1;
+  e = &zs->ent[off];
+  nchunk = (e->len + ZSWAP_CHUNKSZ - 1) / ZSWAP_CHUNKSZ;
+
+  if (zswap_alloc(krnl, nchunk, &pfpn, &chunk) == 0)
+  {
+    idx = zswap_insert(krnl, mm, pgn, pfpn, chunk,
+                       krnl->mram->storage + e->fpn * PAGING64_PAGESZ +
+                       e->chunk * ZSWAP_CHUNKSZ, e->len);
+    return pgtbl_set_swap(krnl, mm, pgn, ZSWAP_SWPTYP, idx);
+  }
+
+  if (swap_get_slot(krnl, mm, pgn, &swptyp, &swpfpn) != 0)
+    return -1;
+  mp = &krnl->mswp[swptyp];
+  MEMPHY_seq_xfer(mp, swpfpn * PAGING64_PAGESZ, PAGING64_PAGESZ);
+  zswap_decompress(krnl->mram->storage + e->fpn * PAGING64_PAGESZ +
+                   e->chunk * ZSWAP_CHUNKSZ, e->len,
+                   mp->storage + swpfpn * PAGING64_PAGESZ, PAGING64_PAGESZ);
+  return pgtbl_set_swap(krnl, mm, pgn, swptyp, swpfpn);
+}
+
+/*
+ * zswap_load - decompress a cached page into a RAM frame, the entry
+ * is released since the page is resident again
+ */
+int zswap_load(struct krnl_t *krnl, addr_t off, addr_t tgtfpn)
+{
+  struct zswap_t *zs = krnl->zswap;
+  struct zswap_entry_t *e;
+
+  if (zs == NULL || off >= zs->nent || zs->ent[off].owner == NULL)
+    return -1;
+  e = &zs->ent[off];
+  if (zswap_decompress(krnl->mram->storage + e->fpn * PAGING64_PAGESZ +
+                       e->chunk * ZSWAP_CHUNKSZ, e->len,
+                       krnl->mram->storage + tgtfpn * PAGING64_PAGESZ,
+                       PAGING64_PAGESZ) != 0)
+    return -1;
+  zs->nr_load++;
+  zswap_drop(krnl, off);
+  return 0;
+}
+
+/*
+ * zswap_invalidate - forget a cached page whose owner unmapped it
+ */
+void zswap_invalidate(struct krnl_t *krnl, addr_t off)
+{
+  struct zswap_t *zs = krnl->zswap;
+
+  if (zs != NULL && off < zs->nent && zs->ent[off].owner != NULL)
+    zswap_drop(krnl, off);
+}
+
+#endif  //def MM64
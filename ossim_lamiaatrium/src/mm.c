@@ -16,6 +16,7 @@
 #include "mm.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #if !defined(MM64)
 /*
@@ -134,7 +135,7 @@ int pte_set_fpn(struct pcb_t *caller, addr_t pgn, addr_t fpn)
  * @pgn    : page number
  * @ret    : page table entry
  **/
-uint32_t pte_get_entry(struct pcb_t *caller, addr_t pgn)
+uint64_t pte_get_entry(struct pcb_t *caller, addr_t pgn)
 {
   printf("[ERROR] %s: This feature 32 bit mode is deprecated\n", __func__);
   return 0;
@@ -145,7 +146,7 @@ uint32_t pte_get_entry(struct pcb_t *caller, addr_t pgn)
  * @pgn    : page number
  * @ret    : page table entry
  **/
-int pte_set_entry(struct pcb_t *caller, addr_t pgn, uint32_t pte_val)
+int pte_set_entry(struct pcb_t *caller, addr_t pgn, uint64_t pte_val)
 {
 	struct krnl_t *krnl = caller->krnl;
 	krnl->mm->pgd[pgn]=pte_val;
@@ -225,6 +226,8 @@ int __swap_cp_page(struct memphy_struct *mpsrc, addr_t srcfpn,
  */
 int init_mm(struct mm_struct *mm, struct pcb_t *caller)
 {
+  /* Left empty, free_pcb_memph finds no page table to walk */
+  memset(mm, 0, sizeof(struct mm_struct));
   printf("[ERROR] %s: This feature 32 bit mode is deprecated\n", __func__);
   return 0;
 }
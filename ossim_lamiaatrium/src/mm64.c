@@ -14,6 +14,7 @@
  */
 
 #include "mm64.h"
+#include "evlog.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
@@ -46,7 +47,7 @@ int init_pte(addr_t *pte,
     }
     else
     { // page swapped
-      SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
+      CLRBIT(*pte, PAGING_PTE_PRESENT_MASK);
       SETBIT(*pte, PAGING_PTE_SWAPPED_MASK);
       CLRBIT(*pte, PAGING_PTE_DIRTY_MASK);
 
@@ -102,67 +103,420 @@ int get_pd_from_pagenum(addr_t pgn, addr_t* pgd, addr_t* p4d, addr_t* pud, addr_
 }
 
 
+/* How pgtbl_walk treats what it meets on the way */
+#define PGTBL_WALK_LOOKUP 0  /* stop at a huge entry, create nothing */
+#define PGTBL_WALK_SPLIT  1  /* split huge entries, create nothing else */
+#define PGTBL_WALK_ALLOC  2  /* split huge entries, create missing tables */
+
+/*
+ * pgtbl_split - turn a huge PMD entry back into a table of 512 PTEs
+ * @mm   : memory map
+ * @slot : the PMD entry
+ * @pgn  : any page inside the huge page
+ *
+ * The other pages of the huge page join the FIFO, the first one
+ * is already there
+ */
+static int pgtbl_split(struct mm_struct *mm, uint64_t *slot, addr_t pgn)
+{
+  struct pgtbl64_t *pt = calloc(1, sizeof(struct pgtbl64_t));
+  uint64_t pte = *slot & ~PAGING64_PTE_HUGE_MASK;
+  addr_t fpn = PAGING_FPN(pte);
+  addr_t base = pgn & ~(addr_t)(PAGING64_HUGE_PGNUM - 1);
+  int i;
+
+  if (pt == NULL)
+    return -1;
+
+  for (i = 0; i < PAGING64_HUGE_PGNUM; i++) {
+    uint64_t ent = pte;
+    SETVAL(ent, (fpn + i), PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+    pt->ent[i] = ent;
+    if (i > 0)
+      enlist_pgn_node(mm, base + i, fpn + i);
+  }
+  pt->nr_used = PAGING64_HUGE_PGNUM;
+  *slot = (uint64_t)(uintptr_t)pt;
+  mm->nr_pgtbl++;
+  mm->nr_huge--;
+  return 0;
+}
+
+/*
+ * pgtbl_walk - walk the page table down to an entry of a page
+ * @mm    : memory map
+ * @pgn   : page number
+ * @mode  : PGTBL_WALK_LOOKUP, PGTBL_WALK_SPLIT or PGTBL_WALK_ALLOC
+ * @lvls  : depth of the entry, 4 for a PTE, 3 for a PMD entry
+ * @path  : receives the table of each level, pgd first
+ * @idx   : receives the index used at each level
+ * Return the entry slot, NULL if a table is missing and cannot be made.
+ * A lookup ending on a huge entry returns it with path[lvls] = NULL
+ */
+static uint64_t *pgtbl_walk(struct mm_struct *mm, addr_t pgn, int mode, int lvls,
+                            struct pgtbl64_t *path[5], addr_t idx[5])
+{
+  struct pgtbl64_t *tbl;
+  int lvl;
+
+  if (get_pd_from_pagenum(pgn, &idx[0], &idx[1], &idx[2], &idx[3], &idx[4]) != 0)
+    return NULL;
+
+  if (mm->pgd == NULL) {
+    if (mode != PGTBL_WALK_ALLOC)
+      return NULL;
+    mm->pgd = calloc(1, sizeof(struct pgtbl64_t));
+    mm->nr_pgtbl++;
+  }
+
+  tbl = mm->pgd;
+  for (lvl = 0; lvl < lvls; lvl++) {
+    path[lvl] = tbl;
+    if (tbl->ent[idx[lvl]] & PAGING64_PTE_HUGE_MASK) {
+      if (mode == PGTBL_WALK_LOOKUP) {
+        path[lvl + 1] = NULL;
+        return &tbl->ent[idx[lvl]];
+      }
+      if (pgtbl_split(mm, &tbl->ent[idx[lvl]], pgn) != 0)
+        return NULL;
+    }
+    if (tbl->ent[idx[lvl]] == 0) {
+      struct pgtbl64_t *child;
+      if (mode != PGTBL_WALK_ALLOC)
+        return NULL;
+      child = calloc(1, sizeof(struct pgtbl64_t));
+      if (child == NULL)
+        return NULL;
+      tbl->ent[idx[lvl]] = (uint64_t)(uintptr_t)child;
+      tbl->nr_used++;
+      mm->nr_pgtbl++;
+    }
+    tbl = (struct pgtbl64_t *)(uintptr_t)tbl->ent[idx[lvl]];
+  }
+  path[lvls] = tbl;
+
+  return &tbl->ent[idx[lvls]];
+}
+
+/*
+ * pgtbl_prune - free the empty tables of a walk, from level lvl up
+ * to but not including the root
+ */
+static void pgtbl_prune(struct mm_struct *mm, struct pgtbl64_t *path[5],
+                        addr_t idx[5], int lvl)
+{
+  for (; lvl > 0 && path[lvl]->nr_used == 0; lvl--) {
+    free(path[lvl]);
+    mm->nr_pgtbl--;
+    path[lvl - 1]->ent[idx[lvl - 1]] = 0;
+    path[lvl - 1]->nr_used--;
+  }
+}
+
+/*
+ * pgtbl_store - write a PTE, creating or pruning tables as needed
+ * @mm    : memory map
+ * @pgn   : page number
+ * @pte   : new entry, 0 unmaps the page
+ *
+ * A huge page holding pgn is split first. A table whose last entry
+ * goes is freed, up to but not including the root
+ */
+int pgtbl_store(struct mm_struct *mm, addr_t pgn, uint64_t pte)
+{
+  struct pgtbl64_t *path[5];
+  addr_t idx[5];
+  uint64_t *slot, old;
+
+  slot = pgtbl_walk(mm, pgn, (pte != 0) ? PGTBL_WALK_ALLOC : PGTBL_WALK_SPLIT,
+                    4, path, idx);
+  if (slot == NULL)
+    return (pte == 0) ? 0 : -1;
+
+  old = *slot;
+  *slot = pte;
+  if (old == 0 && pte != 0) {
+    path[4]->nr_used++;
+  } else if (old != 0 && pte == 0) {
+    path[4]->nr_used--;
+    pgtbl_prune(mm, path, idx, 4);
+  }
+
+  return 0;
+}
+
+/*
+ * pgtbl_store_huge - map a 2 MiB aligned block with one PMD entry
+ * @mm    : memory map
+ * @pgn   : first page, aligned to PAGING64_HUGE_PGNUM
+ * @pte   : PTE of the first frame, the others follow it
+ * Return -1 if part of the block is already mapped by small pages
+ */
+int pgtbl_store_huge(struct mm_struct *mm, addr_t pgn, uint64_t pte)
+{
+  struct pgtbl64_t *path[5];
+  addr_t idx[5];
+  uint64_t *slot;
+
+  if (pgn & (PAGING64_HUGE_PGNUM - 1))
+    return -1;
+
+  slot = pgtbl_walk(mm, pgn, PGTBL_WALK_ALLOC, 3, path, idx);
+  if (slot == NULL || *slot != 0)
+    return -1;
+
+  *slot = pte | PAGING64_PTE_HUGE_MASK;
+  path[3]->nr_used++;
+  mm->nr_huge++;
+  return 0;
+}
+
+/*
+ * pgtbl_load - read a PTE without allocating anything
+ * Return the entry, 0 when the page has none. A page of a huge
+ * mapping gets its own PTE with the HUGE bit kept
+ */
+uint64_t pgtbl_load(struct mm_struct *mm, addr_t pgn)
+{
+  struct pgtbl64_t *path[5];
+  addr_t idx[5];
+  uint64_t *slot = pgtbl_walk(mm, pgn, PGTBL_WALK_LOOKUP, 4, path, idx);
+  uint64_t pte;
+
+  if (slot == NULL)
+    return 0;
+  if (path[4] != NULL)
+    return *slot;
+
+  pte = *slot & ~PAGING64_PTE_HUGE_MASK;
+  SETVAL(pte, (PAGING_FPN(pte) + idx[4]), PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+  return pte | PAGING64_PTE_HUGE_MASK;
+}
+
+/*
+ * pgtbl_update - set and clear flags of a present PTE in place
+ * @mm      : memory map
+ * @pgn     : page number
+ * @setmask : bits to set
+ * @clrmask : bits to clear
+ *
+ * Used for the accessed and dirty bits, so a huge page takes the
+ * change on its PMD entry and is not split
+ */
+int pgtbl_update(struct mm_struct *mm, addr_t pgn, uint64_t setmask, uint64_t clrmask)
+{
+  struct pgtbl64_t *path[5];
+  addr_t idx[5];
+  uint64_t *slot = pgtbl_walk(mm, pgn, PGTBL_WALK_LOOKUP, 4, path, idx);
+
+  if (slot == NULL || *slot == 0)
+    return -1;
+
+  *slot = (*slot & ~clrmask) | setmask;
+  return 0;
+}
+
+/*
+ * map_range - map consecutive pages to a list of frames
+ * @caller : caller
+ * @pgn    : first page
+ * @pgnum  : number of pages
+ * @fpn    : frame of each page in order
+ *
+ * The walk is done once per leaf table, then its PTEs are filled
+ * in a row. Huge pages on the way are split. On failure the pages
+ * mapped so far are left to unmap_range
+ */
+int map_range(struct pcb_t *caller, addr_t pgn, int pgnum, const addr_t *fpn)
+{
+  struct mm_struct *mm = caller->mm;
+  struct pgtbl64_t *path[5];
+  addr_t idx[5];
+  uint64_t *slot;
+  int pgit = 0;
+
+  while (pgit < pgnum) {
+    slot = pgtbl_walk(mm, pgn + pgit, PGTBL_WALK_ALLOC, 4, path, idx);
+    if (slot == NULL)
+      return -1;
+
+    for (; idx[4] < PAGING64_TBL_ENTRIES && pgit < pgnum; idx[4]++, pgit++, slot++) {
+      uint64_t pte = PAGING_PTE_PRESENT_MASK;
+
+      if (*slot == 0)
+        path[4]->nr_used++;
+      else
+        tlb_shootdown(caller->krnl, mm->asid, pgn + pgit);
+      SETVAL(pte, fpn[pgit], PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+      *slot = pte;
+    }
+  }
+  return 0;
+}
+
+/*
+ * unmap_range - clear the PTEs of consecutive pages
+ * @caller : caller
+ * @pgn    : first page
+ * @pgnum  : number of pages
+ *
+ * The frames are left to the caller. A huge page fully inside the
+ * range goes at once, one cut by the range is split first. Tables
+ * left empty are freed
+ */
+int unmap_range(struct pcb_t *caller, addr_t pgn, int pgnum)
+{
+  struct mm_struct *mm = caller->mm;
+  struct pgtbl64_t *path[5];
+  addr_t idx[5];
+  uint64_t *slot;
+  addr_t end = pgn + pgnum;
+
+  while (pgn < end) {
+    slot = pgtbl_walk(mm, pgn, PGTBL_WALK_LOOKUP, 4, path, idx);
+    if (slot != NULL && path[4] == NULL) {
+      if ((pgn & (PAGING64_HUGE_PGNUM - 1)) == 0 && end - pgn >= PAGING64_HUGE_PGNUM) {
+        tlb_shootdown(caller->krnl, mm->asid, pgn);
+        *slot = 0;
+        mm->nr_huge--;
+        path[3]->nr_used--;
+        pgtbl_prune(mm, path, idx, 3);
+        pgn += PAGING64_HUGE_PGNUM;
+        continue;
+      }
+      slot = pgtbl_walk(mm, pgn, PGTBL_WALK_SPLIT, 4, path, idx);
+    }
+    if (slot == NULL) {
+      /* No leaf table here, go on with the next one */
+      pgn = (pgn | (PAGING64_TBL_ENTRIES - 1)) + 1;
+      continue;
+    }
+
+    for (; idx[4] < PAGING64_TBL_ENTRIES && pgn < end; idx[4]++, pgn++, slot++) {
+      if (*slot == 0)
+        continue;
+      tlb_shootdown(caller->krnl, mm->asid, pgn);
+      *slot = 0;
+      path[4]->nr_used--;
+    }
+    pgtbl_prune(mm, path, idx, 4);
+  }
+  return 0;
+}
+
+static int pgtbl_visit(struct pgtbl64_t *tbl, int lvl, addr_t base,
+                       int (*fn)(addr_t pgn, uint64_t pte, void *arg), void *arg)
+{
+  int i, j, ret;
+
+  for (i = 0; i < PAGING64_TBL_ENTRIES; i++) {
+    addr_t pgn = (base << 9) | i;
+    uint64_t ent = tbl->ent[i];
+    if (ent == 0)
+      continue;
+    if (ent & PAGING64_PTE_HUGE_MASK) {
+      /* Seen as its 512 pages, each with its own frame */
+      ent &= ~PAGING64_PTE_HUGE_MASK;
+      for (j = 0, ret = 0; j < PAGING64_HUGE_PGNUM && ret == 0; j++) {
+        uint64_t pte = ent;
+        SETVAL(pte, (PAGING_FPN(ent) + j), PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+        ret = fn((pgn << 9) | j, pte, arg);
+      }
+    } else if (lvl == 4)
+      ret = fn(pgn, ent, arg);
+    else
+      ret = pgtbl_visit((struct pgtbl64_t *)(uintptr_t)ent, lvl + 1,
+                        pgn, fn, arg);
+    if (ret != 0)
+      return ret;
+  }
+  return 0;
+}
+
+/*
+ * pgtbl_for_each - call fn on every nonzero PTE, by increasing pgn
+ * Stop at and return the first nonzero value fn returns
+ */
+int pgtbl_for_each(struct mm_struct *mm,
+                   int (*fn)(addr_t pgn, uint64_t pte, void *arg), void *arg)
+{
+  if (mm->pgd == NULL)
+    return 0;
+  return pgtbl_visit(mm->pgd, 0, 0, fn, arg);
+}
+
+static void pgtbl_release(struct pgtbl64_t *tbl, int lvl)
+{
+  int i;
+
+  if (lvl < 4)
+    for (i = 0; i < PAGING64_TBL_ENTRIES; i++)
+      if (tbl->ent[i] != 0 && !(tbl->ent[i] & PAGING64_PTE_HUGE_MASK))
+        pgtbl_release((struct pgtbl64_t *)(uintptr_t)tbl->ent[i], lvl + 1);
+  free(tbl);
+}
+
+/*
+ * pgtbl_free - drop the whole page table of a memory map
+ */
+void pgtbl_free(struct mm_struct *mm)
+{
+  if (mm->pgd != NULL)
+    pgtbl_release(mm->pgd, 0);
+  mm->pgd = NULL;
+  mm->nr_pgtbl = 0;
+  mm->nr_huge = 0;
+}
+
 /*
  * pte_set_swap - Set PTE entry for swapped page
  * @pte    : target page table entry (PTE)
  * @swptyp : swap type
  * @swpoff : swap offset
+ *
+ * A swapped page is not present, its frame and flags are dropped
  */
 int pte_set_swap(struct pcb_t *caller, addr_t pgn, int swptyp, addr_t swpoff)
 {
-  struct mm_struct *mm = caller->mm;
-  addr_t pgd_idx, p4d_idx, pud_idx, pmd_idx, pt_idx;
-  int ret;
-  
-  ret = get_pd_from_pagenum(pgn, &pgd_idx, &p4d_idx, &pud_idx, &pmd_idx, &pt_idx);
-  if (ret != 0) {
-    return ret;  /* Invalid page directory index */
-  }
-  
-  if (mm->pt == NULL) {
-    mm->pt = (uint64_t*)calloc(512, sizeof(uint64_t));
-  }
-  
-  addr_t *pte = &mm->pt[pt_idx];
-	
-  SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
-  SETBIT(*pte, PAGING_PTE_SWAPPED_MASK);
-  SETVAL(*pte, swptyp, PAGING_PTE_SWPTYP_MASK, PAGING_PTE_SWPTYP_LOBIT);
-  SETVAL(*pte, swpoff, PAGING_PTE_SWPOFF_MASK, PAGING_PTE_SWPOFF_LOBIT);
+  return pgtbl_set_swap(caller->krnl, caller->mm, pgn, swptyp, swpoff);
+}
 
-  return 0;
+/*
+ * pgtbl_set_swap - pte_set_swap on any address space
+ * @krnl  : kernel, for the TLB shootdown
+ * @mm    : address space owning the page
+ *
+ * Global reclaim swaps out pages of processes other than the caller
+ */
+int pgtbl_set_swap(struct krnl_t *krnl, struct mm_struct *mm, addr_t pgn,
+                   int swptyp, addr_t swpoff)
+{
+  uint64_t pte = 0;
+
+  SETBIT(pte, PAGING_PTE_SWAPPED_MASK);
+  SETVAL(pte, swptyp, PAGING_PTE_SWPTYP_MASK, PAGING_PTE_SWPTYP_LOBIT);
+  SETVAL(pte, swpoff, PAGING_PTE_SWPOFF_MASK, PAGING_PTE_SWPOFF_LOBIT);
+
+  tlb_shootdown(krnl, mm->asid, pgn);
+  return pgtbl_store(mm, pgn, pte);
 }
 
 /*
  * pte_set_fpn - Set PTE entry for on-line page
  * @pte   : target page table entry (PTE)
  * @fpn   : frame page number (FPN)
+ *
+ * The entry starts clean and not accessed
  */
 int pte_set_fpn(struct pcb_t *caller, addr_t pgn, addr_t fpn)
 {
-  struct mm_struct *mm = caller->mm;
-  addr_t pgd_idx, p4d_idx, pud_idx, pmd_idx, pt_idx;
-  int ret;
-  
-  ret = get_pd_from_pagenum(pgn, &pgd_idx, &p4d_idx, &pud_idx, &pmd_idx, &pt_idx);
-  if (ret != 0) {
-    return ret;  /* Invalid page directory index */
-  }
-  
-  if (mm->pt == NULL) {
-    mm->pt = (uint64_t*)calloc(512, sizeof(uint64_t));
-  }
-  if (mm->pgd) mm->pgd[pgd_idx] |= PAGING_PTE_PRESENT_MASK;
-  if (mm->p4d) mm->p4d[p4d_idx] |= PAGING_PTE_PRESENT_MASK;
-  if (mm->pud) mm->pud[pud_idx] |= PAGING_PTE_PRESENT_MASK;
-  if (mm->pmd) mm->pmd[pmd_idx] |= PAGING_PTE_PRESENT_MASK;
-  addr_t *pte = &mm->pt[pt_idx];
+  uint64_t pte = 0;
 
-  SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
-  CLRBIT(*pte, PAGING_PTE_SWAPPED_MASK);
-  SETVAL(*pte, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+  SETBIT(pte, PAGING_PTE_PRESENT_MASK);
+  SETVAL(pte, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
 
-  return 0;
+  tlb_shootdown(caller->krnl, caller->mm->asid, pgn);
+  return pgtbl_store(caller->mm, pgn, pte);
 }
 
 
@@ -171,22 +525,9 @@ int pte_set_fpn(struct pcb_t *caller, addr_t pgn, addr_t fpn)
  * @pgn    : page number
  * @ret    : page table entry
  **/
-uint32_t pte_get_entry(struct pcb_t *caller, addr_t pgn)
+uint64_t pte_get_entry(struct pcb_t *caller, addr_t pgn)
 {
-  struct mm_struct *mm = caller->mm;
-  addr_t pgd_idx, p4d_idx, pud_idx, pmd_idx, pt_idx;
-  int ret;
-  
-  ret = get_pd_from_pagenum(pgn, &pgd_idx, &p4d_idx, &pud_idx, &pmd_idx, &pt_idx);
-  if (ret != 0) {
-    return 0;  /* Invalid page directory index - return 0 */
-  }
-  
-  if (mm->pt == NULL) {
-    return 0;
-  }
-  
-  return (uint32_t)mm->pt[pt_idx];
+  return pgtbl_load(caller->mm, pgn);
 }
 
 /* Set PTE page table entry
@@ -194,24 +535,10 @@ uint32_t pte_get_entry(struct pcb_t *caller, addr_t pgn)
  * @pgn    : page number
  * @ret    : page table entry
  **/
-int pte_set_entry(struct pcb_t *caller, addr_t pgn, uint32_t pte_val)
-{
-	struct mm_struct *mm = caller->mm;
-	addr_t pgd_idx, p4d_idx, pud_idx, pmd_idx, pt_idx;
-	int ret;
-	
-	ret = get_pd_from_pagenum(pgn, &pgd_idx, &p4d_idx, &pud_idx, &pmd_idx, &pt_idx);
-	if (ret != 0) {
-		return ret;  /* Invalid page directory index */
-	}
-	
-	if (mm->pt == NULL) {
-		mm->pt = (uint64_t*)calloc(512, sizeof(uint64_t));
-	}
-	
-	mm->pt[pt_idx] = pte_val;
-	
-	return 0;
+int pte_set_entry(struct pcb_t *caller, addr_t pgn, uint64_t pte_val)
+{
+	tlb_shootdown(caller->krnl, caller->mm->asid, pgn);
+	return pgtbl_store(caller->mm, pgn, pte_val);
 }
 
 
@@ -224,172 +551,60 @@ int vmap_pgd_memset(struct pcb_t *caller,           // process call
 {
   struct mm_struct *mm = caller->mm;
   int ret;
-  
-  /* Allocate page directories if not exist */
-  if (mm->pgd == NULL) {
-    mm->pgd = (uint64_t*)calloc(512, sizeof(uint64_t));
-  }
-  if (mm->p4d == NULL) {
-    mm->p4d = (uint64_t*)calloc(512, sizeof(uint64_t));
-  }
-  if (mm->pud == NULL) {
-    mm->pud = (uint64_t*)calloc(512, sizeof(uint64_t));
-  }
-  if (mm->pmd == NULL) {
-    mm->pmd = (uint64_t*)calloc(512, sizeof(uint64_t));
-  }
-  if (mm->pt == NULL) {
-    mm->pt = (uint64_t*)calloc(512, sizeof(uint64_t));
-  }
-  
-  /* Memset page table entries with pattern */
+
+  /* Memset page table entries with pattern, the tables on the way
+   * are created by the store */
   for (int pgit = 0; pgit < pgnum; pgit++)
   {
     addr_t current_addr = addr + (pgit * PAGING64_PAGESZ);
-    addr_t pgd_idx, p4d_idx, pud_idx, pmd_idx, pt_idx;
-    
-    ret = get_pd_from_address(current_addr, &pgd_idx, &p4d_idx, &pud_idx, &pmd_idx, &pt_idx);
+
+    tlb_shootdown(caller->krnl, mm->asid, current_addr >> PAGING64_ADDR_PT_SHIFT);
+    ret = pgtbl_store(mm, current_addr >> PAGING64_ADDR_PT_SHIFT,
+                      0xdeadbeef | PAGING_PTE_PRESENT_MASK);
     if (ret != 0) {
       return ret;  /* Invalid page directory index */
     }
-    
-    /* Mark entries as present with dummy pattern */
-    mm->pgd[pgd_idx] = 0xdeadbeef | PAGING_PTE_PRESENT_MASK;
-    mm->p4d[p4d_idx] = 0xdeadbeef | PAGING_PTE_PRESENT_MASK;
-    mm->pud[pud_idx] = 0xdeadbeef | PAGING_PTE_PRESENT_MASK;
-    mm->pmd[pmd_idx] = 0xdeadbeef | PAGING_PTE_PRESENT_MASK;
-    mm->pt[pt_idx]   = 0xdeadbeef | PAGING_PTE_PRESENT_MASK;
   }
 
   return 0;
 }
 
 /*
- * vmap_page_range - map a range of page at aligned address
- */
-addr_t vmap_page_range(struct pcb_t *caller,           // process call
-                    addr_t addr,                       // start address which is aligned to pagesz
-                    int pgnum,                      // num of mapping page
-                    struct framephy_struct *frames, // list of the mapped frames
-                    struct vm_rg_struct *ret_rg)    // return mapped region, the real mapped fp
-{
-  struct mm_struct *mm = caller->mm;
-  struct framephy_struct *fpit = frames;
-  int pgit = 0;
-  int ret;
-  
-  /* Update return region boundaries */
-  if (ret_rg != NULL) {
-    ret_rg->rg_start = addr;
-    ret_rg->rg_end = addr + (pgnum * PAGING64_PAGESZ);
-  }
-  
-  /* Ensure page directories exist */
-  if (mm->pgd == NULL) mm->pgd = (uint64_t*)calloc(512, sizeof(uint64_t));
-  if (mm->p4d == NULL) mm->p4d = (uint64_t*)calloc(512, sizeof(uint64_t));
-  if (mm->pud == NULL) mm->pud = (uint64_t*)calloc(512, sizeof(uint64_t));
-  if (mm->pmd == NULL) mm->pmd = (uint64_t*)calloc(512, sizeof(uint64_t));
-  if (mm->pt == NULL)  mm->pt  = (uint64_t*)calloc(512, sizeof(uint64_t));
-  
-  /* Map range of frames to address space */
-  for (pgit = 0; pgit < pgnum; pgit++)
-  {
-    addr_t current_addr = addr + (pgit * PAGING64_PAGESZ);
-    addr_t pgn = current_addr >> PAGING64_ADDR_PT_SHIFT;
-    addr_t fpn = (fpit != NULL) ? fpit->fpn : pgit;
-    
-    /* Set page table entry */
-    ret = pte_set_fpn(caller, pgn, fpn);
-    if (ret != 0) {
-      return ret;  /* Error setting page table entry */
-    }
-    
-    /* Tracking for page replacement (FIFO) */
-    enlist_pgn_node(&mm->fifo_pgn, pgn);
-    
-    if (fpit != NULL)
-      fpit = fpit->fp_next;
-  }
-  
-  return 0;
-}
-
-/*
- * alloc_pages_range - allocate req_pgnum of frame in ram
- * @caller    : caller
- * @req_pgnum : request page num
- * @frm_lst   : frame list
+ * vmap_huge_page - map one huge page with contiguous cleared frames
+ * @caller : caller
+ * @pgn    : first page, aligned to PAGING64_HUGE_PGNUM
+ * Return -1 when part of the block is mapped already or RAM has no
+ * such run of frames left
  */
-
-addr_t alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struct **frm_lst)
+int vmap_huge_page(struct pcb_t *caller, addr_t pgn)
 {
+  struct memphy_struct *mram = caller->krnl->mram;
+  struct pgtbl64_t *path[5];
+  addr_t idx[5];
+  uint64_t *slot;
   addr_t fpn;
-  int pgit;
-  struct framephy_struct *newfp_str = NULL;
-  struct framephy_struct *prev_fp = NULL;
-  
-  for (pgit = 0; pgit < req_pgnum; pgit++)
-  {
-    if (MEMPHY_get_freefp(caller->krnl->mram, &fpn) == 0)
-    {
-      newfp_str = malloc(sizeof(struct framephy_struct));
-      newfp_str->fpn = fpn;
-      newfp_str->fp_next = NULL;
-      
-      if (*frm_lst == NULL) {
-        *frm_lst = newfp_str;
-      } else {
-        prev_fp->fp_next = newfp_str;
-      }
-      prev_fp = newfp_str;
-    }
-    else
-    {
-      /* Not enough frames - return error code */
-      return -3000;
-    }
-  }
-  
-  return 0;
-}
+  uint64_t pte = 0;
+  int i;
 
-/*
- * vm_map_ram - do the mapping all vm are to ram storage device
- * @caller    : caller
- * @astart    : vm area start
- * @aend      : vm area end
- * @mapstart  : start mapping point
- * @incpgnum  : number of mapped page
- * @ret_rg    : returned region
- */
-addr_t vm_map_ram(struct pcb_t *caller, addr_t astart, addr_t aend, addr_t mapstart, int incpgnum, struct vm_rg_struct *ret_rg)
-{
-  struct framephy_struct *frm_lst = NULL;
-  addr_t ret_alloc = 0;
-  
-  /*@bksysnet: author provides a feasible solution of getting frames
-   *FATAL logic in here, wrong behaviour if we have not enough page
-   *i.e. we request 1000 frames meanwhile our RAM has size of 3 frames
-   *Don't try to perform that case in this simple work, it will result
-   *in endless procedure of swap-off to get frame and we have not provide
-   *duplicate control mechanism, keep it simple
-   */
-  
-  /* Allocate physical frames */
-  ret_alloc = alloc_pages_range(caller, incpgnum, &frm_lst);
-  
-  if (ret_alloc < 0 && ret_alloc != -3000)
+  slot = pgtbl_walk(caller->mm, pgn, PGTBL_WALK_LOOKUP, 3, path, idx);
+  if (slot != NULL && *slot != 0)
     return -1;
-  
-  /* Out of memory */
-  if (ret_alloc == -3000)
+  if (MEMPHY_get_freefp_range(mram, PAGING64_HUGE_PGNUM, &fpn) != 0)
+    return -1;
+  MEMPHY_clear_frames(mram, fpn, PAGING64_HUGE_PGNUM, PAGING64_PAGESZ);
+
+  SETBIT(pte, PAGING_PTE_PRESENT_MASK);
+  SETVAL(pte, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+  if (PAGING_FPN(pte) != fpn ||
+      pgtbl_store_huge(caller->mm, pgn, pte) != 0)
   {
+    for (i = 0; i < PAGING64_HUGE_PGNUM; i++)
+      MEMPHY_put_freefp(mram, fpn + i);
     return -1;
   }
-  
-  /* Map pages to address space */
-  vmap_page_range(caller, mapstart, incpgnum, frm_lst, ret_rg);
-  
+
+  /* The whole huge page is a single FIFO entry until it is split */
+  enlist_pgn_node(caller->mm, pgn, fpn);
   return 0;
 }
 
@@ -402,19 +617,7 @@ addr_t vm_map_ram(struct pcb_t *caller, addr_t astart, addr_t aend, addr_t mapst
 int __swap_cp_page(struct memphy_struct *mpsrc, addr_t srcfpn,
                    struct memphy_struct *mpdst, addr_t dstfpn)
 {
-  int cellidx;
-  addr_t addrsrc, addrdst;
-  for (cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++)
-  {
-    addrsrc = srcfpn * PAGING_PAGESZ + cellidx;
-    addrdst = dstfpn * PAGING_PAGESZ + cellidx;
-
-    BYTE data;
-    MEMPHY_read(mpsrc, addrsrc, &data);
-    MEMPHY_write(mpdst, addrdst, data);
-  }
-
-  return 0;
+  return MEMPHY_xfer_page(mpsrc, srcfpn, mpdst, dstfpn, PAGING64_PAGESZ);
 }
 
 /*
@@ -426,12 +629,12 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
 {
   struct vm_area_struct *vma0 = malloc(sizeof(struct vm_area_struct));
   
-  /* Initialize 5-level page table directories */
-  mm->pgd = (uint64_t*)calloc(512, sizeof(uint64_t));
-  mm->p4d = (uint64_t*)calloc(512, sizeof(uint64_t));
-  mm->pud = (uint64_t*)calloc(512, sizeof(uint64_t));
-  mm->pmd = (uint64_t*)calloc(512, sizeof(uint64_t));
-  mm->pt  = (uint64_t*)calloc(512, sizeof(uint64_t));
+  /* Only the root of the 5-level page table, the lower levels
+   * are allocated by the first mapping that needs them */
+  mm->pgd = calloc(1, sizeof(struct pgtbl64_t));
+  mm->nr_pgtbl = 1;
+  mm->nr_huge = 0;
+  mm->asid = caller->pid;
 
   /* By default the owner comes with at least one vma */
   vma0->vm_id = 0;
@@ -440,6 +643,7 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   vma0->sbrk = vma0->vm_start;
   
   struct vm_rg_struct *first_rg = init_vm_rg(vma0->vm_start, vma0->vm_end);
+  vma0->vm_freerg_list = NULL;
   enlist_vm_rg_node(&vma0->vm_freerg_list, first_rg);
 
   /* Update VMA0 next */
@@ -458,11 +662,193 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
     mm->symrgtbl[i].rg_next = NULL;
   }
   
-  mm->fifo_pgn = NULL;
+  mm->frm_mp = caller->krnl->mram;
+  mm->policy = (caller->krnl->mm_policy != NULL) ? caller->krnl->mm_policy
+                                                 : mm_policy_get(NULL);
+  for (int i = 0; i < MM_NR_PGLIST; i++) {
+    mm->pglist[i].head = mm->pglist[i].tail = FRAME_NIL;
+    mm->pglist[i].nr = 0;
+  }
+  mm->arc = NULL;
+  mm->activity = 0;
+  mm->users = 1;
+  mm_lock_init(mm);
+
+  pthread_mutex_lock(&caller->krnl->mmvm_lock);
+  mm_link(caller->krnl, mm);
+  pthread_mutex_unlock(&caller->krnl->mmvm_lock);
 
   return 0;
 }
 
+/* Copy a list of regions, in the same order */
+static struct vm_rg_struct *dup_rg_list(struct vm_rg_struct *rg)
+{
+  struct vm_rg_struct *head = NULL, **pp = &head;
+
+  for (; rg != NULL; rg = rg->rg_next) {
+    *pp = init_vm_rg(rg->rg_start, rg->rg_end);
+    pp = &(*pp)->rg_next;
+  }
+  return head;
+}
+
+struct dup_mm_arg {
+  struct krnl_t *krnl;
+  struct mm_struct *mm;
+};
+
+/* Give the new address space the page of one PTE of the old one */
+static int dup_pte(addr_t pgn, uint64_t pte, void *arg)
+{
+  struct dup_mm_arg *d = (struct dup_mm_arg *)arg;
+  struct krnl_t *krnl = d->krnl;
+  addr_t fpn, tgtfpn;
+  int swptyp;
+
+  if ((pte & PAGING_PTE_SWAPPED_MASK) && PAGING_SWPTYP(pte) == ZSWAP_SWPTYP)
+    return zswap_dup(krnl, PAGING_SWP(pte), d->mm, pgn);
+
+  if (pte & PAGING_PTE_SWAPPED_MASK) {
+    if (swap_get_slot(krnl, d->mm, pgn, &swptyp, &tgtfpn) != 0)
+      return -1;
+    __swap_cp_page(&krnl->mswp[PAGING_SWPTYP(pte)], PAGING_SWP(pte),
+                   &krnl->mswp[swptyp], tgtfpn);
+    return pgtbl_set_swap(krnl, d->mm, pgn, swptyp, tgtfpn);
+  }
+
+  if (!PAGING_PAGE_PRESENT(pte))
+    return 0;
+  if (pte & PAGING_PTE_ZERO_MASK)
+    return pgtbl_store(d->mm, pgn, pte & ~PAGING64_PTE_HUGE_MASK);
+  if (krnl->mram->fdesc[PAGING_FPN(pte)].shm != 0)
+    return pgtbl_store(d->mm, pgn, pte);   /* stays shared, see shm_dup */
+
+  /* Sharing a page of a huge page splits it, the pages after the
+   * first are listed by then */
+  fpn = PAGING_FPN(pte);
+  if (frame_share(krnl, fpn, d->mm, pgn) == 0)
+    return 0;
+
+  /* Only a frame nobody lists cannot be shared, it is copied */
+  if (MEMPHY_get_freefp(krnl->mram, &tgtfpn) != 0)
+    return -1;
+  __swap_cp_page(krnl->mram, fpn, krnl->mram, tgtfpn);
+  pte = PAGING_PTE_PRESENT_MASK;
+  SETVAL(pte, tgtfpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+  pgtbl_store(d->mm, pgn, pte);
+  enlist_pgn_node(d->mm, pgn, tgtfpn);
+  return 0;
+}
+
+/*
+ * dup_mm - make mm a copy of the address space of another process
+ * @mm:     self mm
+ * @caller: mm owner
+ * @src:    address space copied
+ *
+ * The areas, regions and symbols are copied. Resident pages are not:
+ * both sides map each frame read only, and the first write to it from
+ * either side copies it, see pg_getpage. A swapped page gets a slot of
+ * its own, a shared memory segment stays attached to both. On failure
+ * mm is left complete enough for free_pcb_memph
+ */
+int dup_mm(struct mm_struct *mm, struct pcb_t *caller, struct mm_struct *src)
+{
+  struct vm_area_struct *vma, **pp = &mm->mmap;
+  struct dup_mm_arg arg = { caller->krnl, mm };
+  int i, ret;
+
+  mm->pgd = calloc(1, sizeof(struct pgtbl64_t));
+  mm->nr_pgtbl = 1;
+  mm->nr_huge = 0;
+  mm->asid = caller->pid;
+  mm->users = 1;
+  mm_lock_init(mm);
+
+  /* Held to the end, threads of src may change it meanwhile. mm is
+   * held too, reclaim finds it as soon as it is linked */
+  pthread_mutex_lock(&src->lock);
+  pthread_mutex_lock(&mm->lock);
+  for (vma = src->mmap; vma != NULL; vma = vma->vm_next) {
+    *pp = malloc(sizeof(struct vm_area_struct));
+    **pp = *vma;
+    (*pp)->vm_mm = mm;
+    (*pp)->vm_freerg_list = dup_rg_list(vma->vm_freerg_list);
+    pp = &(*pp)->vm_next;
+  }
+  *pp = NULL;
+
+  for (i = 0; i < PAGING_MAX_SYMTBL_SZ; i++) {
+    mm->symrgtbl[i] = src->symrgtbl[i];
+    mm->symrgtbl[i].rg_next = NULL;
+  }
+
+  mm->frm_mp = src->frm_mp;
+  mm->policy = src->policy;
+  for (i = 0; i < MM_NR_PGLIST; i++) {
+    mm->pglist[i].head = mm->pglist[i].tail = FRAME_NIL;
+    mm->pglist[i].nr = 0;
+  }
+  mm->arc = NULL;
+  mm->activity = 0;
+
+  pthread_mutex_lock(&caller->krnl->mmvm_lock);
+  mm_link(caller->krnl, mm);
+  ret = pgtbl_for_each(src, dup_pte, &arg);
+  if (ret == 0)
+    ret = shm_dup(caller->krnl, mm, src);
+  pthread_mutex_unlock(&caller->krnl->mmvm_lock);
+  pthread_mutex_unlock(&mm->lock);
+  pthread_mutex_unlock(&src->lock);
+
+  return (ret != 0) ? -1 : 0;
+}
+
+/*
+ * mm_lock_init - make the lock of a new mm
+ *
+ * It is recursive: a thread faulting in its own mm may pick one of
+ * its pages for reclaim, or settle one of its shared frames, and
+ * tries the lock again then
+ */
+void mm_lock_init(struct mm_struct *mm)
+{
+  pthread_mutexattr_t attr;
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&mm->lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+/*
+ * mm_link - put mm on the kernel list walked by the global reclaim
+ * mm_unlink - take it off, once its frames are gone
+ *
+ * Both run under the mmvm_lock
+ */
+void mm_link(struct krnl_t *krnl, struct mm_struct *mm)
+{
+  mm->mm_next = krnl->mm_list;
+  krnl->mm_list = mm;
+}
+
+void mm_unlink(struct krnl_t *krnl, struct mm_struct *mm)
+{
+  struct mm_struct **pp;
+
+  for (pp = &krnl->mm_list; *pp != NULL; pp = &(*pp)->mm_next)
+  {
+    if (*pp == mm)
+    {
+      *pp = mm->mm_next;
+      mm->mm_next = NULL;
+      return;
+    }
+  }
+}
+
 struct vm_rg_struct *init_vm_rg(addr_t rg_start, addr_t rg_end)
 {
   struct vm_rg_struct *rgnode = malloc(sizeof(struct vm_rg_struct));
@@ -482,14 +868,33 @@ int enlist_vm_rg_node(struct vm_rg_struct **rglist, struct vm_rg_struct *rgnode)
   return 0;
 }
 
-int enlist_pgn_node(struct pgn_t **plist, addr_t pgn)
+/*
+ * enlist_pgn_node - hand a page that became resident to the policy
+ * @mm  : memory map
+ * @pgn : page number
+ * @fpn : frame backing the page, its descriptor is the list node
+ */
+int enlist_pgn_node(struct mm_struct *mm, addr_t pgn, addr_t fpn)
 {
-  struct pgn_t *pnode = malloc(sizeof(struct pgn_t));
+  if (mm->frm_mp == NULL || fpn >= mm->frm_mp->numfp)
+    return -1;
 
-  pnode->pgn = pgn;
-  pnode->pg_next = *plist;
-  *plist = pnode;
+  mm->policy->insert(mm, pgn, fpn);
+  return 0;
+}
 
+/*
+ * delist_pgn_node - take the page of a frame off the policy lists
+ * @mm  : memory map
+ * @fpn : frame backing the page
+ * Return -1 if the frame is not listed by mm
+ */
+int delist_pgn_node(struct mm_struct *mm, addr_t fpn)
+{
+  if (fpn >= mm->frm_mp->numfp || mm->frm_mp->fdesc[fpn].owner != mm)
+    return -1;
+
+  mm->policy->remove(mm, fpn);
   return 0;
 }
 
@@ -541,35 +946,41 @@ int print_list_vma(struct vm_area_struct *ivma)
   return 0;
 }
 
-int print_list_pgn(struct pgn_t *ip)
+int print_list_pgn(struct mm_struct *mm)
 {
+  addr_t fpn;
+  int i;
+
   printf("print_list_pgn: ");
-  if (ip == NULL) { printf("NULL list\n"); return -1; }
+  if (mm->pglist[0].nr + mm->pglist[1].nr == 0) { printf("NULL list\n"); return -1; }
   printf("\n");
-  while (ip != NULL)
+  for (i = 0; i < MM_NR_PGLIST; i++)
   {
-    printf("va[" FORMAT_ADDR "]-\n", ip->pgn);
-    ip = ip->pg_next;
+    for (fpn = mm->pglist[i].head; fpn != FRAME_NIL; fpn = mm->frm_mp->fdesc[fpn].next)
+      printf("va[" FORMAT_ADDR "]-\n", mm->frm_mp->fdesc[fpn].pgn);
   }
-  printf("n");
+  printf("\n");
   return 0;
 }
 
 int print_pgtbl(struct pcb_t *caller, addr_t start, addr_t end)
 {
   struct mm_struct *mm = caller->mm;
-  
+  struct pgtbl64_t *path[5] = { mm->pgd, NULL, NULL, NULL, NULL };
+  addr_t idx[5];
+
   /* Expected output format shows memory addresses of page directories
    * NOT the actual PTE values
    * Format: "PDG=<addr> P4g=<addr> PUD=<addr> PMD=<addr>"
+   * The tables are the ones on the walk of [start], NULL when absent
    */
-  
-  printf("print_pgtbl:\n PDG=%p P4g=%p PUD=%p PMD=%p\n",
-         (void*)mm->pgd,
-         (void*)mm->p4d,
-         (void*)mm->pud,
-         (void*)mm->pmd);
-  fflush(stdout);
+  pgtbl_walk(mm, start >> PAGING64_ADDR_PT_SHIFT, PGTBL_WALK_LOOKUP, 4, path, idx);
+
+  evlog_event(caller->krnl->log, EV_PGTBL, caller->pid,
+              (uintptr_t)path[0],
+              (uintptr_t)path[1],
+              (uintptr_t)path[2],
+              (uintptr_t)path[3]);
   return 0;
 }
 
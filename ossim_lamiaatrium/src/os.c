@@ -4,256 +4,534 @@
 #include "sched.h"
 #include "loader.h"
 #include "mm.h"
+#include "os.h"
+#include "evlog.h"
+#include "ckpt.h"
+#include "mm64.h"
 
 #include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 
-static int time_slot;
-static int num_cpus;
-static int done = 0;
-static struct krnl_t os;
-
-#ifdef MM_PAGING
-static int memramsz;
-static int memswpsz[PAGING_MAX_MMSWP];
-
-struct mmpaging_ld_args {
-	int vmemsz;
-	struct memphy_struct *mram;
-	struct memphy_struct **mswp;
-	struct memphy_struct *active_mswp;
-	int active_mswp_id;
-	struct timer_id_t  *timer_id;
+struct ld_routine_args {
+	struct krnl_t * krnl;
+	struct timer_id_t * timer_id;
 };
-#endif
-
-static struct ld_args{
-	char ** path;
-	unsigned long * start_time;
-#ifdef MLQ_SCHED
-	unsigned long * prio;
-#endif
-} ld_processes;
-int num_processes;
 
 struct cpu_args {
+	struct krnl_t * krnl;
 	struct timer_id_t * timer_id;
 	int id;
 };
 
 
+/*
+ * The CPU state lives in krnl->cpus[id] rather than in locals: every
+ * slot ends in next_slot() and restarts at the loop head, so that
+ * state alone is enough to resume a CPU from a snapshot.
+ */
 static void * cpu_routine(void * args) {
+	struct krnl_t * krnl = ((struct cpu_args*)args)->krnl;
 	struct timer_id_t * timer_id = ((struct cpu_args*)args)->timer_id;
 	int id = ((struct cpu_args*)args)->id;
-	int time_left = 0;
-	struct pcb_t * proc = NULL;
-	while (1) {
-		if (proc == NULL) {
-			proc = get_proc();
-			if (proc == NULL) {
+	struct cpu_state_t * cpu = &krnl->cpus[id];
+	while (!cpu->stopped) {
+		if (cpu->proc == NULL) {
+			cpu->proc = get_proc(krnl);
+			if (cpu->proc == NULL && !krnl->done) {
 				next_slot(timer_id);
-				continue; 
+				continue;
 			}
-		}else if (proc->pc == proc->code->size) {
-			printf("\tCPU %d: Processed %2d has finished\n",
-				id ,proc->pid);
-            fflush(stdout);
-            finish_proc(proc);
-            
-			free(proc);
-			proc = get_proc();
-			time_left = 0;
-		}else if (time_left == 0) {
-			printf("\tCPU %d: Put process %2d to run queue\n",
-				id, proc->pid);
-			fflush(stdout);
-			put_proc(proc);
-			proc = get_proc();
+		}else if (cpu->proc->pc == cpu->proc->code->size) {
+			evlog_event(krnl->log, EV_CPU_FINISH, id, cpu->proc->pid, 0, 0, 0);
+            finish_proc(krnl, cpu->proc);
+#ifdef MM_PAGING
+			if (cpu->proc->mm != NULL)
+				free_pcb_memph(cpu->proc);
+#endif
+
+			free(cpu->proc);
+			cpu->proc = get_proc(krnl);
+			cpu->time_left = 0;
+		}else if (cpu->time_left == 0) {
+			evlog_event(krnl->log, EV_CPU_PUT, id, cpu->proc->pid, 0, 0, 0);
+			put_proc(krnl, cpu->proc);
+			cpu->proc = get_proc(krnl);
 		}
-		
-		if (proc == NULL && done) {
-			printf("\tCPU %d stopped\n", id);
-			fflush(stdout);
+
+		if (cpu->proc == NULL && krnl->done && running_procs(krnl) == 0) {
+			evlog_event(krnl->log, EV_CPU_STOP, id, 0, 0, 0, 0);
+			cpu->stopped = 1;
 			break;
-		}else if (proc == NULL) {
+		}else if (cpu->proc == NULL) {
 			next_slot(timer_id);
 			continue;
-		}else if (time_left == 0) {
-			printf("\tCPU %d: Dispatched process %2d\n",
-				id, proc->pid);
-			fflush(stdout);
-			time_left = time_slot;
+		}else if (cpu->time_left == 0) {
+			evlog_event(krnl->log, EV_CPU_DISPATCH, id, cpu->proc->pid, 0, 0, 0);
+			cpu->time_left = krnl->time_slot;
 		}
 #ifdef MM_PAGING
         /* Failsafe check */
-        if (proc->mm == NULL) {
-            proc->mm = malloc(sizeof(struct mm_struct));
-            init_mm(proc->mm, proc);
+        if (cpu->proc->mm == NULL) {
+            cpu->proc->mm = malloc(sizeof(struct mm_struct));
+            init_mm(cpu->proc->mm, cpu->proc);
         }
+		cpu->proc->tlb = &cpu->tlb;
 #endif
 
-		run(proc);
-		time_left--;
+		run(cpu->proc);
+		cpu->time_left--;
 		next_slot(timer_id);
 	}
 	detach_event(timer_id);
 	pthread_exit(NULL);
 }
 
-static void * ld_routine(void * args) {
-#ifdef MM_PAGING
-	struct memphy_struct* mram = ((struct mmpaging_ld_args *)args)->mram;
-	struct memphy_struct** mswp = ((struct mmpaging_ld_args *)args)->mswp;
-	struct memphy_struct* active_mswp = ((struct mmpaging_ld_args *)args)->active_mswp;
-	struct timer_id_t * timer_id = ((struct mmpaging_ld_args *)args)->timer_id;
-#else
-	struct timer_id_t * timer_id = (struct timer_id_t*)args;
+#if defined(MM_PAGING) && defined(MM_KSWAPD)
+/*
+ * Background reclaim, a timer daemon: it runs once per slot and
+ * keeps the free RAM frames between the watermarks so that faults
+ * rarely have to swap out a page themselves
+ */
+static void * kswapd_routine(void * args) {
+	struct krnl_t * krnl = ((struct ld_routine_args *)args)->krnl;
+	struct timer_id_t * timer_id = ((struct ld_routine_args *)args)->timer_id;
+
+	while (!timer_id->fsh) {
+		kswapd_balance(krnl);
+		next_slot(timer_id);
+	}
+	pthread_exit(NULL);
+}
 #endif
-	int i = 0;
-	printf("ld_routine\n");
-	fflush(stdout);
-	while (i < num_processes) {
-		while (current_time() < ld_processes.start_time[i]) {
+
+#if defined(MM_PAGING) && defined(MM_KSM)
+/*
+ * Same page merging, a timer daemon: each slot it checksums the next
+ * MM_KSM_SCAN frames of RAM and merges the pages found identical
+ */
+static void * ksmd_routine(void * args) {
+	struct krnl_t * krnl = ((struct ld_routine_args *)args)->krnl;
+	struct timer_id_t * timer_id = ((struct ld_routine_args *)args)->timer_id;
+
+	while (!timer_id->fsh) {
+		ksm_scan(krnl, MM_KSM_SCAN);
+		next_slot(timer_id);
+	}
+	pthread_exit(NULL);
+}
+#endif
+
+static void * ld_routine(void * args) {
+	struct krnl_t * krnl = ((struct ld_routine_args *)args)->krnl;
+	struct timer_id_t * timer_id = ((struct ld_routine_args *)args)->timer_id;
+	struct ld_args * ld_processes = krnl->ld_processes;
+	int i;
+	if (ld_processes->next == 0)
+		evlog_event(krnl->log, EV_LD_ROUTINE, 0, 0, 0, 0, 0);
+	while ((i = ld_processes->next) < ld_processes->num_processes) {
+		while (current_time(&krnl->timer) < ld_processes->start_time[i]) {
 			next_slot(timer_id);
 		}
-		struct pcb_t * proc = load(ld_processes.path[i]);
-		struct krnl_t * krnl = proc->krnl = &os;	
+		struct pcb_t * proc = load(krnl, ld_processes->path[i]);
 
 #ifdef MLQ_SCHED
-		proc->prio = ld_processes.prio[i];
+		proc->prio = ld_processes->prio[i];
 #endif
-		
+
 #ifdef MM_PAGING
 		proc->mm = malloc(sizeof(struct mm_struct));
         if (proc->mm != NULL) {
             init_mm(proc->mm, proc);
         }
-		krnl->mram = mram;
-		krnl->mswp = mswp;
-		krnl->active_mswp = active_mswp;
 #endif
-		printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
-			ld_processes.path[i], proc->pid, ld_processes.prio[i]);
-		fflush(stdout);
-		add_proc(proc);
-		free(ld_processes.path[i]);
-		i++;
+		evlog_str(krnl->log, EV_LD_LOADED, proc->pid, ld_processes->prio[i],
+			ld_processes->path[i]);
+		add_proc(krnl, proc);
+		free(ld_processes->path[i]);
+		ld_processes->path[i] = NULL;
+		ld_processes->next++;
 		next_slot(timer_id);
 	}
-	free(ld_processes.path);
-	free(ld_processes.start_time);
-	done = 1;
+	free(ld_processes->path);
+	free(ld_processes->start_time);
+	ld_processes->path = NULL;
+	ld_processes->start_time = NULL;
+#ifdef MLQ_SCHED
+	free(ld_processes->prio);
+	ld_processes->prio = NULL;
+#endif
+	krnl->done = 1;
 	detach_event(timer_id);
 	pthread_exit(NULL);
 }
 
-static void read_config(const char * path) {
+static int read_config(struct krnl_t * krnl, const char * path) {
 	FILE * file;
+	struct ld_args * ld_processes = krnl->ld_processes;
 	if ((file = fopen(path, "r")) == NULL) {
 		printf("Cannot find configure file at %s\n", path);
 		fflush(stdout);
-		exit(1);
+		return -1;
 	}
-	fscanf(file, "%d %d %d\n", &time_slot, &num_cpus, &num_processes);
-	ld_processes.path = (char**)malloc(sizeof(char*) * num_processes);
-	ld_processes.start_time = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
+	fscanf(file, "%d %d %d\n", &krnl->time_slot, &krnl->num_cpus,
+		&ld_processes->num_processes);
+	ld_processes->path = (char**)malloc(sizeof(char*) * ld_processes->num_processes);
+	ld_processes->start_time = (unsigned long*)
+		malloc(sizeof(unsigned long) * ld_processes->num_processes);
 #ifdef MM_PAGING
 	int sit;
 #ifdef MM_FIXED_MEMSZ
 	/* We provide here a back compatible with legacy OS simulatiom config file
          * In which, it have no addition config line for Mema, keep only one line
-	 * for legacy info 
+	 * for legacy info
          *  [time slice] [N = Number of CPU] [M = Number of Processes to be run]
          */
-        memramsz    =  0x100000;
-        memswpsz[0] = 0x1000000;
+        ld_processes->memramsz    =  0x100000;
+        ld_processes->memswpsz[0] = 0x1000000;
 	for(sit = 1; sit < PAGING_MAX_MMSWP; sit++)
-		memswpsz[sit] = 0;
+		ld_processes->memswpsz[sit] = 0;
 #else
-	fscanf(file, "%d\n", &memramsz);
-	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
-		fscanf(file, "%d", &(memswpsz[sit])); 
+	/* A legacy config has no memory line, its second line already
+	 * describes a process: [start time] [program] [priority].
+	 * Fall back to the fixed sizes and leave the line to the loop below */
+	long pos = ftell(file);
+	char line[256], tok[100];
+	unsigned long t;
+	int legacy = fgets(line, sizeof(line), file) != NULL &&
+		sscanf(line, "%lu %99s", &t, tok) == 2 &&
+		(tok[0] < '0' || tok[0] > '9');
+	fseek(file, pos, SEEK_SET);
 
-       fscanf(file, "\n"); 
+	if (legacy) {
+		ld_processes->memramsz    =  0x100000;
+		ld_processes->memswpsz[0] = 0x1000000;
+		for(sit = 1; sit < PAGING_MAX_MMSWP; sit++)
+			ld_processes->memswpsz[sit] = 0;
+	} else {
+		/* A swap size may be followed by "@<priority>", higher
+		 * priority devices are filled first and equal ones are
+		 * striped, all are 0 by default. Then ":<host file>" backs
+		 * that device with a persistent file, e.g. 16777216@1:swap0.img.
+		 * The line may end with the page replacement policy:
+		 * fifo (default), clock, lru or arc */
+		fscanf(file, "%d\n", &ld_processes->memramsz);
+		for(sit = 0; sit < PAGING_MAX_MMSWP; sit++) {
+			fscanf(file, "%d", &(ld_processes->memswpsz[sit]));
+			int c = fgetc(file);
+			if (c == '@') {
+				fscanf(file, "%d", &(ld_processes->memswpprio[sit]));
+				c = fgetc(file);
+			}
+			if (c == ':') {
+				char swpfile[100];
+				if (fscanf(file, "%99s", swpfile) == 1)
+					ld_processes->memswpfile[sit] = strdup(swpfile);
+			} else if (c != EOF) {
+				ungetc(c, file);
+			}
+		}
+		char policy[16];
+		if (fscanf(file, "%*[ \t]%15[a-z]", policy) == 1 &&
+		    (krnl->mm_policy = mm_policy_get(policy)) == NULL) {
+			printf("Unknown replacement policy %s, using fifo\n", policy);
+			krnl->mm_policy = mm_policy_get(NULL);
+		}
+		fscanf(file, "\n");
+	}
 #endif
 #endif
 
 #ifdef MLQ_SCHED
-	ld_processes.prio = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
+	ld_processes->prio = (unsigned long*)
+		malloc(sizeof(unsigned long) * ld_processes->num_processes);
 #endif
 	int i;
-	for (i = 0; i < num_processes; i++) {
-		ld_processes.path[i] = (char*)malloc(sizeof(char) * 100);
-		ld_processes.path[i][0] = '\0';
-		strcat(ld_processes.path[i], "input/proc/");
-		char proc[100];
+	for (i = 0; i < ld_processes->num_processes; i++) {
+		ld_processes->path[i] = (char*)malloc(sizeof(char) * 100);
+		ld_processes->path[i][0] = '\0';
+		strcat(ld_processes->path[i], "input/proc/");
+		char proc[100] = "";
 #ifdef MLQ_SCHED
-		fscanf(file, "%lu %s %lu\n", &ld_processes.start_time[i], proc, &ld_processes.prio[i]);
+		fscanf(file, "%lu %s %lu\n", &ld_processes->start_time[i], proc, &ld_processes->prio[i]);
 #else
-		fscanf(file, "%lu %s\n", &ld_processes.start_time[i], proc);
+		fscanf(file, "%lu %s\n", &ld_processes->start_time[i], proc);
 #endif
-		strcat(ld_processes.path[i], proc);
+		strcat(ld_processes->path[i], proc);
 	}
+	fclose(file);
+	return 0;
 }
 
-int main(int argc, char * argv[]) {
-    setbuf(stdout, NULL);
+/*
+ * os_on_slot - timer hook, runs between two slots while every
+ *              CPU and the loader are parked in next_slot()
+ */
+static void os_on_slot(struct sys_timer_t * timer, void * arg) {
+	struct krnl_t * krnl = (struct krnl_t *)arg;
 
-	if (argc != 2) {
-		printf("Usage: os [path to configure file]\n");
-		fflush(stdout);
-		return 1;
+	if (krnl->ckpt_path != NULL && current_time(timer) == krnl->ckpt_time) {
+		if (ckpt_save(krnl, krnl->ckpt_path) != 0)
+			evlog_printf(krnl->log, "Cannot write snapshot at %s\n", krnl->ckpt_path);
 	}
-	char path[100];
-	path[0] = '\0';
-	strcat(path, "input/");
-	strcat(path, argv[1]);
-	read_config(path);
+}
+
+#ifdef MM_PAGING
+/*
+ * os_mm_stats - print the memory statistics of a finished run
+ */
+static void os_mm_stats(struct krnl_t * krnl, int num_cpus) {
+	int i, sit, nshm;
+	uint64_t shmpages;
+
+	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++) {
+		struct memphy_struct * swp = &krnl->mswp[sit];
+		if (swp->maxsz > 0)
+			evlog_printf(krnl->log, "Swap %d: priority %d, %lu pages written\n",
+			             sit, krnl->mswp_prio[sit], krnl->nr_swpout_dev[sit]);
+		if (!swp->rdmflg && swp->maxsz > 0)
+			evlog_printf(krnl->log, "Swap %d: %lu seeks, %lu us simulated device time\n",
+			             sit, swp->nseek, swp->busy_ns / 1000);
+	}
+	evlog_printf(krnl->log, "Replacement %s: %lu page faults, %lu from swap, "
+	             "%lu pages read ahead\n", krnl->mm_policy->name,
+	             krnl->nr_pgfault, krnl->nr_pgfault_swp, krnl->nr_readahead);
+	evlog_printf(krnl->log, "Swap out: %lu pages written, %lu clean pages dropped, "
+	             "%lu taken from another process\n",
+	             krnl->nr_swpout, krnl->nr_swpout_clean, krnl->nr_steal);
+	evlog_printf(krnl->log, "Reclaim: %lu frames by kswapd, %lu by faults\n",
+	             krnl->nr_kswapd, krnl->nr_reclaim - krnl->nr_kswapd);
+	if (krnl->zswap != NULL) {
+		struct zswap_t * zs = krnl->zswap;
+		uint64_t ratio = zs->bytes_stored ?
+		                 zs->nr_store * PAGING64_PAGESZ * 100 / zs->bytes_stored : 0;
+		evlog_printf(krnl->log, "Zswap: %lu stored, %lu rejected, %lu without room, "
+		             "%lu written back, ratio %lu.%02lu, %lu%% of swap faults hit\n",
+		             zs->nr_store, zs->nr_reject, zs->nr_nomem, zs->nr_writeback,
+		             ratio / 100, ratio % 100,
+		             krnl->nr_pgfault_swp ? zs->nr_load * 100 / krnl->nr_pgfault_swp : 0);
+	}
+	if (krnl->ksm != NULL) {
+		struct ksm_t * ks = krnl->ksm;
+		evlog_printf(krnl->log, "KSM: %lu pages merged, %lu to the zero frame, "
+		             "%lu copied on write, up to %lu frames saved, "
+		             "%lu passes\n", ks->nr_merge, ks->nr_zero, krnl->nr_cow,
+		             ks->max_saved, ks->nr_pass);
+	}
+	for (i = 0, nshm = 0, shmpages = 0; i < MM_SHM_MAX; i++) {
+		if (krnl->shm[i].fpn == NULL)
+			continue;
+		nshm++;
+		shmpages += krnl->shm[i].npages;
+	}
+	if (nshm > 0)
+		evlog_printf(krnl->log, "Shared memory: %d segments, %lu frames\n",
+		             nshm, shmpages);
+	for (i = 0; i < num_cpus; i++) {
+		struct tlb_t * tlb = &krnl->cpus[i].tlb;
+		uint64_t nref = tlb->hits + tlb->misses;
+		evlog_printf(krnl->log, "CPU %d TLB: %lu hits, %lu misses, %lu shootdowns, %lu%% hit rate\n",
+		             i, tlb->hits, tlb->misses, tlb->shootdowns,
+		             nref ? tlb->hits * 100 / nref : 0);
+	}
+}
+#endif
+
+/*
+ * os_release - free what os_simulate set up in a kernel instance
+ *
+ * Used both at the end of a run and when it stops early, so it only
+ * frees what exists: the loader arrays are gone once it has run.
+ */
+static void os_release(struct krnl_t * krnl) {
+	struct ld_args * ld_processes = krnl->ld_processes;
+	int i;
+
+	if (ld_processes->path != NULL)
+		for (i = 0; i < ld_processes->num_processes; i++)
+			free(ld_processes->path[i]);
+	free(ld_processes->path);
+	free(ld_processes->start_time);
+#ifdef MLQ_SCHED
+	free(ld_processes->prio);
+#endif
+	finish_scheduler(krnl);
+#ifdef MM_PAGING
+	for (i = 0; i < PAGING_MAX_MMSWP; i++)
+		free(ld_processes->memswpfile[i]);
+	free_memphy(krnl->mram);
+	for (i = 0; i < PAGING_MAX_MMSWP; i++)
+		free_memphy(&krnl->mswp[i]);
+#ifdef MM64
+	if (krnl->zswap != NULL) {
+		zswap_destroy(krnl->zswap);
+		free(krnl->zswap);
+	}
+	if (krnl->ksm != NULL) {
+		ksm_destroy(krnl->ksm);
+		free(krnl->ksm);
+	}
+	if (krnl->shm != NULL)
+		shm_destroy(krnl->shm);
+#endif
+	free(krnl->shm);
+	free(krnl->mram);
+	free(krnl->mswp);
+	pthread_mutex_destroy(&krnl->mmvm_lock);
+	for (i = 0; krnl->cpus != NULL && i < krnl->num_cpus; i++)
+		tlb_destroy(&krnl->cpus[i].tlb);
+#endif
+	free(krnl->cpus);
+}
 
+/*
+ * os_simulate - run one simulation from a configure file
+ * @path : configure file path
+ * @opts : simulation options
+ *
+ * Every piece of state is kept in a local kernel instance, so
+ * the routine may be called from several host threads at once.
+ */
+int os_simulate(const char * path, struct os_opts_t * opts) {
+	struct krnl_t krnl;
+	struct ld_args ld_processes;
+	struct evlog_t log;
+
+	memset(&krnl, 0, sizeof(struct krnl_t));
+	memset(&ld_processes, 0, sizeof(struct ld_args));
+	krnl.ld_processes = &ld_processes;
+	krnl.avail_pid = 1;
+	krnl.ckpt_path = opts->ckpt_path;
+	krnl.ckpt_time = opts->ckpt_time;
+	init_timer(&krnl.timer);
+	init_scheduler(&krnl);
+#ifdef MM_PAGING
+	krnl.mram = calloc(1, sizeof(struct memphy_struct));
+	krnl.mswp = calloc(PAGING_MAX_MMSWP, sizeof(struct memphy_struct));
+	krnl.mm_policy = mm_policy_get(NULL);
+	pthread_mutex_init(&krnl.mmvm_lock, NULL);
+#endif
+
+	if (opts->restore_path != NULL) {
+		krnl.time_slot = opts->time_slot;
+		krnl.num_cpus = opts->num_cpus;
+		if (ckpt_restore(&krnl, opts->restore_path) != 0) {
+			printf("Cannot restore snapshot at %s\n", opts->restore_path);
+			os_release(&krnl);
+			return -1;
+		}
+	} else {
+		if (read_config(&krnl, path) != 0) {
+			os_release(&krnl);
+			return -1;
+		}
+		krnl.cpus = calloc(krnl.num_cpus, sizeof(struct cpu_state_t));
+#ifdef MM_PAGING
+		for (int i = 0; i < krnl.num_cpus; i++)
+			tlb_init(&krnl.cpus[i].tlb);
+#endif
+	}
+
+	if (evlog_init(&log, opts->log_mode, opts->log_path) != 0) {
+		os_release(&krnl);
+		return -1;
+	}
+	krnl.log = &log;
+	krnl.timer.log = &log;
+	krnl.timer.on_slot = os_on_slot;
+	krnl.timer.on_slot_arg = &krnl;
+
+	int num_cpus = krnl.num_cpus;
 	pthread_t * cpu = (pthread_t*)malloc(num_cpus * sizeof(pthread_t));
 	struct cpu_args * args =
 		(struct cpu_args*)malloc(sizeof(struct cpu_args) * num_cpus);
+	struct ld_routine_args ld_args;
 	pthread_t ld;
-	
+#if defined(MM_PAGING) && defined(MM_KSWAPD)
+	struct ld_routine_args kswapd_args;
+	pthread_t kswapd;
+#endif
+#if defined(MM_PAGING) && defined(MM_KSM)
+	struct ld_routine_args ksmd_args;
+	pthread_t ksmd;
+#endif
+
 	int i;
 	for (i = 0; i < num_cpus; i++) {
-		args[i].timer_id = attach_event();
+		args[i].krnl = &krnl;
+		args[i].timer_id = attach_event(&krnl.timer);
 		args[i].id = i;
 	}
-	struct timer_id_t * ld_event = attach_event();
-	start_timer();
+	ld_args.krnl = &krnl;
+	ld_args.timer_id = attach_event(&krnl.timer);
+#if defined(MM_PAGING) && defined(MM_KSWAPD)
+	kswapd_args.krnl = &krnl;
+	kswapd_args.timer_id = attach_daemon(&krnl.timer);
+#endif
+#if defined(MM_PAGING) && defined(MM_KSM)
+	ksmd_args.krnl = &krnl;
+	ksmd_args.timer_id = attach_daemon(&krnl.timer);
+#endif
+	start_timer(&krnl.timer);
 
+	int sit;
 #ifdef MM_PAGING
-	int rdmflag = 1; 
-
-	struct memphy_struct mram;
-	struct memphy_struct mswp[PAGING_MAX_MMSWP];
+	if (opts->restore_path == NULL) {
+		int rdmflag = 1;
+		addr_t zero_fpn;
 
-	init_memphy(&mram, memramsz, rdmflag);
-
-	int sit;
-	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
-	       init_memphy(&mswp[sit], memswpsz[sit], rdmflag);
+		init_memphy(krnl.mram, ld_processes.memramsz, rdmflag);
+		/* Frame 0 is kept aside as the shared zero frame */
+		if (PAGING_HAS_ZERO_FRAME(krnl.mram))
+			MEMPHY_get_freefp_range(krnl.mram, 1, &zero_fpn);
+#ifdef MM_SEQ_SWAP
+		rdmflag = 0;
+#endif
 
-	struct mmpaging_ld_args *mm_ld_args = malloc(sizeof(struct mmpaging_ld_args));
+		for(sit = 0; sit < PAGING_MAX_MMSWP; sit++) {
+			char * swpfile = ld_processes.memswpfile[sit];
+			if (swpfile == NULL)
+				init_memphy(&krnl.mswp[sit], ld_processes.memswpsz[sit], rdmflag);
+			else if (init_memphy_file(&krnl.mswp[sit],
+			         ld_processes.memswpsz[sit], rdmflag, swpfile) != 0) {
+				evlog_printf(&log, "Cannot map swap file %s, using memory\n", swpfile);
+				init_memphy(&krnl.mswp[sit], ld_processes.memswpsz[sit], rdmflag);
+			}
+			free(swpfile);
+			ld_processes.memswpfile[sit] = NULL;
+		}
 
-	mm_ld_args->timer_id = ld_event;
-	mm_ld_args->mram = (struct memphy_struct *) &mram;
-	mm_ld_args->mswp = (struct memphy_struct**) &mswp;
-	mm_ld_args->active_mswp = (struct memphy_struct *) &mswp[0];
-        mm_ld_args->active_mswp_id = 0;
+		krnl.active_mswp = &krnl.mswp[0];
+		krnl.active_mswp_id = 0;
+		for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
+			krnl.mswp_prio[sit] = ld_processes.memswpprio[sit];
+	}
+#ifdef MM_ZSWAP
+	/* A snapshot brings its own cache back */
+	if (krnl.zswap == NULL &&
+	    krnl.mram->numfp * MM_ZSWAP_POOL_PCT / 100 > 0) {
+		krnl.zswap = malloc(sizeof(struct zswap_t));
+		zswap_init(krnl.zswap, krnl.mram->numfp);
+	}
+#endif
+#ifdef MM_KSM
+	if (krnl.ksm == NULL) {
+		krnl.ksm = malloc(sizeof(struct ksm_t));
+		ksm_init(krnl.ksm, krnl.mram->numfp);
+	}
+#endif
+	if (krnl.shm == NULL)
+		krnl.shm = calloc(MM_SHM_MAX, sizeof(struct shm_seg_t));
 #endif
 
-	init_scheduler();
-
-#ifdef MM_PAGING
-	pthread_create(&ld, NULL, ld_routine, (void*)mm_ld_args);
-#else
-	pthread_create(&ld, NULL, ld_routine, (void*)ld_event);
+	pthread_create(&ld, NULL, ld_routine, (void*)&ld_args);
+#if defined(MM_PAGING) && defined(MM_KSWAPD)
+	pthread_create(&kswapd, NULL, kswapd_routine, (void*)&kswapd_args);
+#endif
+#if defined(MM_PAGING) && defined(MM_KSM)
+	pthread_create(&ksmd, NULL, ksmd_routine, (void*)&ksmd_args);
 #endif
 	for (i = 0; i < num_cpus; i++) {
 		pthread_create(&cpu[i], NULL,
@@ -264,9 +542,95 @@ int main(int argc, char * argv[]) {
 		pthread_join(cpu[i], NULL);
 	}
 	pthread_join(ld, NULL);
+#if defined(MM_PAGING) && defined(MM_KSWAPD)
+	pthread_join(kswapd, NULL);
+#endif
+#if defined(MM_PAGING) && defined(MM_KSM)
+	pthread_join(ksmd, NULL);
+#endif
 
-	stop_timer();
+	stop_timer(&krnl.timer);
+#ifdef MM_PAGING
+	/* Text mode output stays the same as without the statistics */
+	if (log.mode == EVLOG_QUIET)
+		os_mm_stats(&krnl, num_cpus);
+#endif
+	evlog_stop(&log);
+
+	os_release(&krnl);
+	free(cpu);
+	free(args);
 
 	return 0;
+}
 
-}
\ No newline at end of file
+static void usage(void) {
+	printf("Usage: os [-q | -b <event log>] [-c <snapshot> -t <slot>] [path to configure file]\n");
+	printf("       os [-q | -b <event log>] -r <snapshot> [-s <time slice>] [-n <CPUs>]\n");
+	printf("       os -d <event log>\n");
+	printf("  -q   quiet, print only the summary statistics\n");
+	printf("  -b   write a binary event log instead of the text output\n");
+	printf("  -d   decode a binary event log to the text output\n");
+	printf("  -c   write a snapshot when the simulation reaches time slot -t\n");
+	printf("  -r   resume from a snapshot, optionally with another time slice\n");
+	printf("       or number of CPUs\n");
+}
+
+int main(int argc, char * argv[]) {
+	struct os_opts_t opts;
+	const char * decode_path = NULL;
+	int opt;
+
+	memset(&opts, 0, sizeof(struct os_opts_t));
+	opts.log_mode = EVLOG_TEXT;
+
+	while ((opt = getopt(argc, argv, "qb:d:c:t:r:s:n:")) != -1) {
+		switch (opt) {
+		case 'q': opts.log_mode = EVLOG_QUIET; break;
+		case 'b': opts.log_mode = EVLOG_BINARY; opts.log_path = optarg; break;
+		case 'd': decode_path = optarg; break;
+		case 'c': opts.ckpt_path = optarg; break;
+		case 't': opts.ckpt_time = strtoull(optarg, NULL, 10); break;
+		case 'r': opts.restore_path = optarg; break;
+		case 's': opts.time_slot = atoi(optarg); break;
+		case 'n': opts.num_cpus = atoi(optarg); break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+
+	if (decode_path != NULL) {
+		FILE * in = fopen(decode_path, "rb");
+		if (in == NULL) {
+			printf("Cannot find event log at %s\n", decode_path);
+			return 1;
+		}
+		int ret = evlog_decode(in, stdout);
+		fclose(in);
+		return (ret == 0) ? 0 : 1;
+	}
+
+	if (opts.restore_path != NULL) {
+		if (optind != argc) {
+			usage();
+			return 1;
+		}
+		return (os_simulate(NULL, &opts) == 0) ? 0 : 1;
+	}
+
+	if (optind != argc - 1) {
+		usage();
+		return 1;
+	}
+	char path[100];
+	path[0] = '\0';
+	strcat(path, "input/");
+	strcat(path, argv[optind]);
+
+	if (os_simulate(path, &opts) != 0)
+		return 1;
+
+	return 0;
+
+}
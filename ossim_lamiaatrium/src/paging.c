@@ -5,8 +5,9 @@
 #include <stdio.h>
 
 int main() {
-	struct pcb_t * ld = load("input/p0");
-	struct pcb_t * proc = load("input/p0");
+	struct krnl_t krnl = { .avail_pid = 1 };
+	struct pcb_t * ld = load(&krnl, "input/p0");
+	struct pcb_t * proc = load(&krnl, "input/p0");
 	unsigned int i;
 	for (i = 0; i < proc->code->size; i++) {
 		run(proc);
@@ -10,54 +10,65 @@
 
 #include "queue.h"
 #include "sched.h"
+#include "evlog.h"
 #include <pthread.h>
 
 #include <stdlib.h>
 #include <stdio.h>
-static struct queue_t ready_queue;
-static struct queue_t run_queue;
-static pthread_mutex_t queue_lock;
-
-static struct queue_t running_list;
-#ifdef MLQ_SCHED
-static struct queue_t mlq_ready_queue[MAX_PRIO];
-static int slot[MAX_PRIO];
-static int current_slot[MAX_PRIO]; 
-static int current_prio = 0;
-static pthread_mutex_t dispatch_lock = PTHREAD_MUTEX_INITIALIZER;
-#endif
-
-int queue_empty(void) {
+int queue_empty(struct krnl_t * krnl) {
 #ifdef MLQ_SCHED
 	unsigned long prio;
 	for (prio = 0; prio < MAX_PRIO; prio++)
-		if (!empty(&mlq_ready_queue[prio])) 
+		if (!empty(&krnl->mlq_ready_queue[prio])) 
 			return -1;
 #endif
-	return (empty(&ready_queue) && empty(&run_queue));
+	return (empty(krnl->ready_queue) && empty(krnl->run_queue));
+}
+
+/* Processes on a CPU, any of them may still fork another one */
+int running_procs(struct krnl_t * krnl) {
+	int n;
+	pthread_mutex_lock(&krnl->queue_lock);
+	n = krnl->running_list->size;
+	pthread_mutex_unlock(&krnl->queue_lock);
+	return n;
 }
 
-void init_scheduler(void) {
+void init_scheduler(struct krnl_t * krnl) {
+	krnl->ready_queue = calloc(1, sizeof(struct queue_t));
+	krnl->run_queue = calloc(1, sizeof(struct queue_t));
+	krnl->running_list = calloc(1, sizeof(struct queue_t));
 #ifdef MLQ_SCHED
-    int i ;
+	int i ;
+	krnl->mlq_ready_queue = calloc(MAX_PRIO, sizeof(struct queue_t));
 	for (i = 0; i < MAX_PRIO; i ++) {
-		mlq_ready_queue[i].size = 0;
-		slot[i] = MAX_PRIO - i; 
-		current_slot[i] = 0;
+		krnl->slot[i] = MAX_PRIO - i; 
+		krnl->current_slot[i] = 0;
 	}
-	current_prio = 0;
+	krnl->current_prio = 0;
+	pthread_mutex_init(&krnl->dispatch_lock, NULL);
 #endif
-	ready_queue.size = 0;
-	run_queue.size = 0;
-	running_list.size = 0;
-	pthread_mutex_init(&queue_lock, NULL);
+	pthread_mutex_init(&krnl->queue_lock, NULL);
 }
 
-void finish_proc(struct pcb_t * proc) {
+void finish_scheduler(struct krnl_t * krnl) {
+	free(krnl->ready_queue);
+	free(krnl->run_queue);
+	free(krnl->running_list);
+	krnl->ready_queue = krnl->run_queue = krnl->running_list = NULL;
+#ifdef MLQ_SCHED
+	free(krnl->mlq_ready_queue);
+	krnl->mlq_ready_queue = NULL;
+	pthread_mutex_destroy(&krnl->dispatch_lock);
+#endif
+	pthread_mutex_destroy(&krnl->queue_lock);
+}
+
+void finish_proc(struct krnl_t * krnl, struct pcb_t * proc) {
     if (proc == NULL) return;
-    pthread_mutex_lock(&queue_lock);
-    purgequeue(&running_list, proc);
-    pthread_mutex_unlock(&queue_lock);
+    pthread_mutex_lock(&krnl->queue_lock);
+    purgequeue(krnl->running_list, proc);
+    pthread_mutex_unlock(&krnl->queue_lock);
 }
 
 #ifdef MLQ_SCHED
@@ -67,12 +78,16 @@ void finish_proc(struct pcb_t * proc) {
  *  We implement stateful here using transition technique
  *  State representation   prio = 0 .. MAX_PRIO, curr_slot = 0..(MAX_PRIO - prio)
  */
-struct pcb_t * get_mlq_proc(void) {
+struct pcb_t * get_mlq_proc(struct krnl_t * krnl) {
     struct pcb_t * proc = NULL;
-    pthread_mutex_lock(&dispatch_lock);
-    pthread_mutex_lock(&queue_lock);
+    struct queue_t * mlq_ready_queue = krnl->mlq_ready_queue;
+    int * slot = krnl->slot;
+    int * current_slot = krnl->current_slot;
+
+    pthread_mutex_lock(&krnl->dispatch_lock);
+    pthread_mutex_lock(&krnl->queue_lock);
     
-    int prio = current_prio;
+    int prio = krnl->current_prio;
     int attempts = 0;
     
     while (attempts < MAX_PRIO) {
@@ -80,15 +95,15 @@ struct pcb_t * get_mlq_proc(void) {
             proc = dequeue(&mlq_ready_queue[prio]);
             if (proc != NULL) {
                 current_slot[prio]++;
-                enqueue(&running_list, proc);
+                enqueue(krnl->running_list, proc);
                 
                 if (current_slot[prio] >= slot[prio]) {
                     current_slot[prio] = 0;
-                    current_prio = (prio + 1) % MAX_PRIO;
+                    krnl->current_prio = (prio + 1) % MAX_PRIO;
                 }
                 
-                pthread_mutex_unlock(&queue_lock);
-                pthread_mutex_unlock(&dispatch_lock);
+                pthread_mutex_unlock(&krnl->queue_lock);
+                pthread_mutex_unlock(&krnl->dispatch_lock);
                 return proc;
             }
         }
@@ -100,118 +115,80 @@ struct pcb_t * get_mlq_proc(void) {
             for (int i = 0; i < MAX_PRIO; i++) {
                 current_slot[i] = 0;
             }
-            current_prio = 0;
+            krnl->current_prio = 0;
         }
     }
     
-    pthread_mutex_unlock(&queue_lock);
-    pthread_mutex_unlock(&dispatch_lock);
+    pthread_mutex_unlock(&krnl->queue_lock);
+    pthread_mutex_unlock(&krnl->dispatch_lock);
     return proc;	
 }
 
-void put_mlq_proc(struct pcb_t * proc) {
+void put_mlq_proc(struct krnl_t * krnl, struct pcb_t * proc) {
 	if (proc == NULL) return;
-	proc->krnl->ready_queue = &ready_queue;
-	proc->krnl->mlq_ready_queue = mlq_ready_queue;
-	proc->krnl->running_list = &running_list;
-	pthread_mutex_lock(&queue_lock);
-	purgequeue(&running_list, proc);
+	pthread_mutex_lock(&krnl->queue_lock);
+	purgequeue(krnl->running_list, proc);
 	if (proc->prio < MAX_PRIO) {
-		enqueue(&mlq_ready_queue[proc->prio], proc);
+		enqueue(&krnl->mlq_ready_queue[proc->prio], proc);
 	}
-	pthread_mutex_unlock(&queue_lock);
+	pthread_mutex_unlock(&krnl->queue_lock);
 }
 
-void add_mlq_proc(struct pcb_t * proc) {
+void add_mlq_proc(struct krnl_t * krnl, struct pcb_t * proc) {
 	if (proc == NULL) return;
 	
-	proc->krnl->ready_queue = &ready_queue;
-	proc->krnl->mlq_ready_queue = mlq_ready_queue;
-	proc->krnl->running_list = &running_list;
-	pthread_mutex_lock(&queue_lock);
+	pthread_mutex_lock(&krnl->queue_lock);
 	if (proc->prio < MAX_PRIO) {
-		enqueue(&mlq_ready_queue[proc->prio], proc);
+		enqueue(&krnl->mlq_ready_queue[proc->prio], proc);
 	} else {
-		printf("Warning: Process PID %d has invalid priority %d\\n", 
-		       proc->pid, proc->prio);
+		evlog_printf(krnl->log, "Warning: Process PID %d has invalid priority %d\n",
+		             proc->pid, proc->prio);
 	}
 	
-	pthread_mutex_unlock(&queue_lock);	
+	pthread_mutex_unlock(&krnl->queue_lock);	
 }
 
-struct pcb_t * get_proc(void) {
-	return get_mlq_proc();
+struct pcb_t * get_proc(struct krnl_t * krnl) {
+	return get_mlq_proc(krnl);
 }
-void put_proc(struct pcb_t * proc) {
-	return put_mlq_proc(proc);
+void put_proc(struct krnl_t * krnl, struct pcb_t * proc) {
+	return put_mlq_proc(krnl, proc);
 }
-void add_proc(struct pcb_t * proc) {
-	return add_mlq_proc(proc);
+void add_proc(struct krnl_t * krnl, struct pcb_t * proc) {
+	return add_mlq_proc(krnl, proc);
 }
 #else
-struct pcb_t * get_proc(void) {
+struct pcb_t * get_proc(struct krnl_t * krnl) {
 	struct pcb_t * proc = NULL;
-	pthread_mutex_lock(&queue_lock);
-	if (!empty(&ready_queue)) {
-		proc = dequeue(&ready_queue);
+	pthread_mutex_lock(&krnl->queue_lock);
+	if (!empty(krnl->ready_queue)) {
+		proc = dequeue(krnl->ready_queue);
 		if (proc != NULL) {
-			enqueue(&running_list, proc);
+			enqueue(krnl->running_list, proc);
 		}
 	}
-	pthread_mutex_unlock(&queue_lock);
+	pthread_mutex_unlock(&krnl->queue_lock);
 	return proc;
 }
 
-void put_proc(struct pcb_t * proc) {
+void put_proc(struct krnl_t * krnl, struct pcb_t * proc) {
 	if (proc == NULL) return;
-	proc->krnl->ready_queue = &ready_queue;
-	proc->krnl->running_list = &running_list;
-	pthread_mutex_lock(&queue_lock);
-	purgequeue(&running_list, proc);
-	enqueue(&run_queue, proc);
-	pthread_mutex_unlock(&queue_lock);
+	pthread_mutex_lock(&krnl->queue_lock);
+	purgequeue(krnl->running_list, proc);
+	enqueue(krnl->run_queue, proc);
+	pthread_mutex_unlock(&krnl->queue_lock);
 }
 
-void add_proc(struct pcb_t * proc) {
+void add_proc(struct krnl_t * krnl, struct pcb_t * proc) {
 	if (proc == NULL) return;
-	proc->krnl->ready_queue = &ready_queue;
-	proc->krnl->running_list = &running_list;
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&ready_queue, proc);
-	pthread_mutex_unlock(&queue_lock);	
+	pthread_mutex_lock(&krnl->queue_lock);
+	enqueue(krnl->ready_queue, proc);
+	pthread_mutex_unlock(&krnl->queue_lock);	
 }
 #endif
 
-struct pcb_t * get_proc_by_pid(int pid) {
-    struct pcb_t * proc = NULL;
-    pthread_mutex_lock(&queue_lock);
-    for (int i = 0; i < running_list.size; i++) {
-        if (running_list.proc[i] != NULL && running_list.proc[i]->pid == pid) {
-            proc = running_list.proc[i];
-            goto found;
-        }
-    }
-#ifdef MLQ_SCHED
-    for (int prio = 0; prio < MAX_PRIO; prio++) {
-        for (int i = 0; i < mlq_ready_queue[prio].size; i++) {
-            if (mlq_ready_queue[prio].proc[i] != NULL && 
-                mlq_ready_queue[prio].proc[i]->pid == pid) {
-                proc = mlq_ready_queue[prio].proc[i];
-                goto found;
-            }
-        }
-    }
-#else
-    for (int i = 0; i < ready_queue.size; i++) {
-        if (ready_queue.proc[i] != NULL && ready_queue.proc[i]->pid == pid) {
-            proc = ready_queue.proc[i];
-            goto found;
-        }
-    }
-#endif
-found:
-    pthread_mutex_unlock(&queue_lock);
-    return proc;
+struct pcb_t * get_proc_by_pid(struct krnl_t * krnl, int pid) {
+    return find_process_by_pid(krnl, pid);
 }
 
 /*
@@ -227,7 +204,7 @@ struct pcb_t *find_process_by_pid(struct krnl_t *krnl, uint32_t pid)
         return NULL;
     }
 
-    pthread_mutex_lock(&queue_lock);
+    pthread_mutex_lock(&krnl->queue_lock);
 
     /* Search in running_list first */
     if (krnl->running_list != NULL) {
@@ -265,6 +242,6 @@ struct pcb_t *find_process_by_pid(struct krnl_t *krnl, uint32_t pid)
 #endif
 
 found_pid:
-    pthread_mutex_unlock(&queue_lock);
+    pthread_mutex_unlock(&krnl->queue_lock);
     return proc;
 }
\ No newline at end of file
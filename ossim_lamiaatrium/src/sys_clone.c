@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+#include "syscall.h"
+#include "common.h"
+#include "sched.h"
+#include "evlog.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if !defined(MM_PAGING) || defined(MM64)
+/*
+ * __sys_clone - start a thread of the calling process
+ * @regs->a1: instruction the thread starts at
+ * @regs->a2: register receiving the PID of the thread in the caller,
+ *            none when outside the register file
+ *
+ * The thread is a process of its own for the scheduler, with cleared
+ * registers, but it runs the same code segment in the same mm. Any
+ * CPU may pick it up, next to the caller. The mm goes with its last
+ * thread, see free_pcb_memph
+ */
+int __sys_clone(struct krnl_t *krnl, uint32_t pid, struct sc_regs *regs)
+{
+   struct pcb_t *parent = find_process_by_pid(krnl, pid);
+   struct pcb_t *thread;
+   arg_t reg = regs->a2;
+
+   if (parent == NULL) {
+       evlog_printf(krnl->log, "[ERROR] __sys_clone: Process PID %d not found in kernel\n", pid);
+       return -1;
+   }
+   if (regs->a1 > parent->code->size)
+       return -1;
+
+   thread = malloc(sizeof(struct pcb_t));
+   if (thread == NULL)
+       return -1;
+   *thread = *parent;
+   thread->tlb = NULL;
+   thread->pc = regs->a1;
+   memset(thread->regs, 0, sizeof(thread->regs));
+   thread->page_table = malloc(sizeof(struct page_table_t));
+   memcpy(thread->page_table, parent->page_table, sizeof(struct page_table_t));
+
+   pthread_mutex_lock(&krnl->queue_lock);
+   thread->pid = krnl->avail_pid++;
+   pthread_mutex_unlock(&krnl->queue_lock);
+
+#ifdef MM_PAGING
+   pthread_mutex_lock(&krnl->mmvm_lock);
+   thread->mm->users++;
+   pthread_mutex_unlock(&krnl->mmvm_lock);
+#endif
+
+   if (reg < sizeof(parent->regs) / sizeof(parent->regs[0]))
+       parent->regs[reg] = thread->pid;
+
+   evlog_event(krnl->log, EV_CLONE, parent->pid, thread->pid, 0, 0, 0);
+   add_proc(krnl, thread);
+   return 0;
+}
+#else
+/*
+ * __sys_clone - the 32-bit mm_struct keeps neither a user count nor a
+ * lock, it cannot be shared by threads
+ */
+int __sys_clone(struct krnl_t *krnl, uint32_t pid, struct sc_regs *regs)
+{
+   return -1;
+}
+#endif
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+#include "syscall.h"
+#include "common.h"
+#include "sched.h"
+#include "evlog.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef MM_PAGING
+#include "mm.h"
+#endif
+
+#if !defined(MM_PAGING) || defined(MM64)
+/*
+ * __sys_fork - make a copy of the calling process
+ * @regs->a1: register receiving the PID of the child in the parent
+ *            and 0 in the child, none when outside the register file
+ *
+ * The child runs the same code segment from the instruction after the
+ * syscall, with a copy of the registers and priority. Its memory is
+ * a copy on write of the parent one, see dup_mm, so no frame is
+ * copied before one of them writes to it
+ */
+int __sys_fork(struct krnl_t *krnl, uint32_t pid, struct sc_regs *regs)
+{
+   struct pcb_t *parent = find_process_by_pid(krnl, pid);
+   struct pcb_t *child;
+   arg_t reg = regs->a1;
+
+   if (parent == NULL) {
+       evlog_printf(krnl->log, "[ERROR] __sys_fork: Process PID %d not found in kernel\n", pid);
+       return -1;
+   }
+
+   child = malloc(sizeof(struct pcb_t));
+   if (child == NULL)
+       return -1;
+   *child = *parent;
+   child->tlb = NULL;
+   child->page_table = malloc(sizeof(struct page_table_t));
+   memcpy(child->page_table, parent->page_table, sizeof(struct page_table_t));
+
+   pthread_mutex_lock(&krnl->queue_lock);
+   child->pid = krnl->avail_pid++;
+   pthread_mutex_unlock(&krnl->queue_lock);
+
+#ifdef MM_PAGING
+   child->mm = malloc(sizeof(struct mm_struct));
+   if (child->mm == NULL || dup_mm(child->mm, child, parent->mm) != 0) {
+       if (child->mm != NULL) {
+           free_pcb_memph(child);
+           free(child->mm);
+       }
+       free(child->page_table);
+       free(child);
+       return -1;
+   }
+#endif
+
+   if (reg < sizeof(parent->regs) / sizeof(parent->regs[0])) {
+       parent->regs[reg] = child->pid;
+       child->regs[reg] = 0;
+   }
+
+   evlog_event(krnl->log, EV_FORK, parent->pid, child->pid, 0, 0, 0);
+   add_proc(krnl, child);
+   return 0;
+}
+#else
+/*
+ * __sys_fork - the 32-bit PTEs have no COW bit, a child cannot share
+ * the frames of its parent
+ */
+int __sys_fork(struct krnl_t *krnl, uint32_t pid, struct sc_regs *regs)
+{
+   return -1;
+}
+#endif
@@ -15,6 +15,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "sched.h"
+#include "evlog.h"
 
 #ifdef MM64
 #include "mm64.h"
@@ -34,7 +35,7 @@ int __sys_memmap(struct krnl_t *krnl, uint32_t pid, struct sc_regs* regs)
    
    /* Safety check */
    if (caller == NULL) {
-       printf("[ERROR] __sys_memmap: Process PID %d not found in kernel\n", pid);
+       evlog_printf(krnl->log, "[ERROR] __sys_memmap: Process PID %d not found in kernel\n", pid);
        return -1;
    }
 
@@ -53,7 +54,11 @@ int __sys_memmap(struct krnl_t *krnl, uint32_t pid, struct sc_regs* regs)
             break;
             
    case SYSMEM_SWP_OP:
-            ret = __mm_swap_page(caller, regs->a2, regs->a3);
+            ret = __mm_swap_page(caller, regs->a2, regs->a4, regs->a3);
+            break;
+
+   case SYSMEM_SWPIN_OP:
+            ret = __mm_swap_in_page(caller, regs->a4, regs->a2, regs->a3);
             break;
             
    case SYSMEM_IO_READ:
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+#include "syscall.h"
+#include "common.h"
+#include "sched.h"
+#include "evlog.h"
+#include "mm.h"
+
+#ifdef MM64
+#define NREGS(proc) (sizeof((proc)->regs) / sizeof((proc)->regs[0]))
+
+/*
+ * __sys_shmget - find or create a shared memory segment
+ * @regs->a1: key, 0 always creates a new segment
+ * @regs->a2: size in bytes
+ * @regs->a3: register receiving the segment id
+ *
+ * Processes calling it with the same key get the same segment, see
+ * shm_get
+ */
+int __sys_shmget(struct krnl_t *krnl, uint32_t pid, struct sc_regs *regs)
+{
+   struct pcb_t *caller = find_process_by_pid(krnl, pid);
+   int id;
+
+   if (caller == NULL) {
+       evlog_printf(krnl->log, "[ERROR] __sys_shmget: Process PID %d not found in kernel\n", pid);
+       return -1;
+   }
+   if (regs->a3 >= NREGS(caller))
+       return -1;
+
+   if (shm_get(krnl, caller, regs->a1, regs->a2, &id) != 0)
+       return -1;
+   caller->regs[regs->a3] = id;
+   return 0;
+}
+
+/*
+ * __sys_shmat - map a segment into the caller
+ * @regs->a1: register holding the segment id
+ * @regs->a2: memory region ID the segment is read and written through
+ */
+int __sys_shmat(struct krnl_t *krnl, uint32_t pid, struct sc_regs *regs)
+{
+   struct pcb_t *caller = find_process_by_pid(krnl, pid);
+
+   if (caller == NULL) {
+       evlog_printf(krnl->log, "[ERROR] __sys_shmat: Process PID %d not found in kernel\n", pid);
+       return -1;
+   }
+   if (regs->a1 >= NREGS(caller))
+       return -1;
+
+   return shm_attach(krnl, caller, caller->regs[regs->a1], regs->a2);
+}
+
+/*
+ * __sys_shmdt - unmap the segment attached at a region of the caller
+ * @regs->a1: memory region ID given to shmat
+ */
+int __sys_shmdt(struct krnl_t *krnl, uint32_t pid, struct sc_regs *regs)
+{
+   struct pcb_t *caller = find_process_by_pid(krnl, pid);
+
+   if (caller == NULL) {
+       evlog_printf(krnl->log, "[ERROR] __sys_shmdt: Process PID %d not found in kernel\n", pid);
+       return -1;
+   }
+
+   return shm_detach(krnl, caller, regs->a1);
+}
+#else
+/* Segments are mapped through the 64-bit page tables only */
+int __sys_shmget(struct krnl_t *krnl, uint32_t pid, struct sc_regs *regs)
+{
+   return -1;
+}
+
+int __sys_shmat(struct krnl_t *krnl, uint32_t pid, struct sc_regs *regs)
+{
+   return -1;
+}
+
+int __sys_shmdt(struct krnl_t *krnl, uint32_t pid, struct sc_regs *regs)
+{
+   return -1;
+}
+#endif
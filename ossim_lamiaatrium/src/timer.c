@@ -1,32 +1,24 @@
 
 #include "timer.h"
+#include "evlog.h"
 #include <stdio.h>
 #include <stdlib.h>
 
-static pthread_t _timer;
-
 struct timer_id_container_t {
 	struct timer_id_t id;
 	struct timer_id_container_t * next;
 };
 
-static struct timer_id_container_t * dev_list = NULL;
-
-static uint64_t _time;
-
-static int timer_started = 0;
-static int timer_stop = 0;
-
-
 static void * timer_routine(void * args) {
-	while (!timer_stop) {
-		printf("Time slot %3lu\n", current_time());
+	struct sys_timer_t * timer = (struct sys_timer_t*)args;
+	while (!timer->stop) {
+		evlog_event(timer->log, EV_TIME_SLOT, 0, current_time(timer), 0, 0, 0);
 		int fsh = 0;
 		int event = 0;
 		/* Wait for all devices have done the job in current
 		 * time slot */
 		struct timer_id_container_t * temp;
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
+		for (temp = timer->dev_list; temp != NULL; temp = temp->next) {
 			pthread_mutex_lock(&temp->id.event_lock);
 			while (!temp->id.done && !temp->id.fsh) {
 				pthread_cond_wait(
@@ -34,7 +26,7 @@ static void * timer_routine(void * args) {
 					&temp->id.event_lock
 				);
 			}
-			if (temp->id.fsh) {
+			if (temp->id.fsh || temp->id.daemon) {
 				fsh++;
 			}
 			event++;
@@ -42,12 +34,18 @@ static void * timer_routine(void * args) {
 		}
 
 		/* Increase the time slot */
-		_time++;
+		timer->time++;
+
+		/* Every device is parked, the kernel state is stable here */
+		if (timer->on_slot != NULL && fsh != event)
+			timer->on_slot(timer, timer->on_slot_arg);
 		
 		/* Let devices continue their job */
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
+		for (temp = timer->dev_list; temp != NULL; temp = temp->next) {
 			pthread_mutex_lock(&temp->id.timer_lock);
 			temp->id.done = 0;
+			if (fsh == event && temp->id.daemon)
+				temp->id.fsh = 1;
 			pthread_cond_signal(&temp->id.timer_cond);
 			pthread_mutex_unlock(&temp->id.timer_lock);
 		}
@@ -55,7 +53,7 @@ static void * timer_routine(void * args) {
 			break;
 		}
 	}
-	pthread_exit(args);
+	pthread_exit(NULL);
 }
 
 void next_slot(struct timer_id_t * timer_id) {
@@ -76,13 +74,23 @@ void next_slot(struct timer_id_t * timer_id) {
 	pthread_mutex_unlock(&timer_id->timer_lock);
 }
 
-uint64_t current_time() {
-	return _time;
+uint64_t current_time(struct sys_timer_t * timer) {
+	return timer->time;
 }
 
-void start_timer() {
-	timer_started = 1;
-	pthread_create(&_timer, NULL, timer_routine, NULL);
+void init_timer(struct sys_timer_t * timer) {
+	timer->dev_list = NULL;
+	timer->time = 0;
+	timer->started = 0;
+	timer->stop = 0;
+	timer->log = NULL;
+	timer->on_slot = NULL;
+	timer->on_slot_arg = NULL;
+}
+
+void start_timer(struct sys_timer_t * timer) {
+	timer->started = 1;
+	pthread_create(&timer->thread, NULL, timer_routine, (void*)timer);
 }
 
 void detach_event(struct timer_id_t * event) {
@@ -92,8 +100,8 @@ void detach_event(struct timer_id_t * event) {
 	pthread_mutex_unlock(&event->event_lock);
 }
 
-struct timer_id_t * attach_event() {
-	if (timer_started) {
+struct timer_id_t * attach_event(struct sys_timer_t * timer) {
+	if (timer->started) {
 		return NULL;
 	}else{
 		struct timer_id_container_t * container =
@@ -102,27 +110,36 @@ struct timer_id_t * attach_event() {
 			);
 		container->id.done = 0;
 		container->id.fsh = 0;
+		container->id.daemon = 0;
 		pthread_cond_init(&container->id.event_cond, NULL);
 		pthread_mutex_init(&container->id.event_lock, NULL);
 		pthread_cond_init(&container->id.timer_cond, NULL);
 		pthread_mutex_init(&container->id.timer_lock, NULL);
-		if (dev_list == NULL) {
-			dev_list = container;
-			dev_list->next = NULL;
+		if (timer->dev_list == NULL) {
+			timer->dev_list = container;
+			timer->dev_list->next = NULL;
 		}else{
-			container->next = dev_list;
-			dev_list = container;
+			container->next = timer->dev_list;
+			timer->dev_list = container;
 		}
 		return &(container->id);
 	}
 }
 
-void stop_timer() {
-	timer_stop = 1;
-	pthread_join(_timer, NULL);
-	while (dev_list != NULL) {
-		struct timer_id_container_t * temp = dev_list;
-		dev_list = dev_list->next;
+struct timer_id_t * attach_daemon(struct sys_timer_t * timer) {
+	struct timer_id_t * id = attach_event(timer);
+	if (id != NULL) {
+		id->daemon = 1;
+	}
+	return id;
+}
+
+void stop_timer(struct sys_timer_t * timer) {
+	timer->stop = 1;
+	pthread_join(timer->thread, NULL);
+	while (timer->dev_list != NULL) {
+		struct timer_id_container_t * temp = timer->dev_list;
+		timer->dev_list = timer->dev_list->next;
 		pthread_cond_destroy(&temp->id.event_cond);
 		pthread_mutex_destroy(&temp->id.event_lock);
 		pthread_cond_destroy(&temp->id.timer_cond);